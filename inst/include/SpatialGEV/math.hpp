@@ -0,0 +1,108 @@
+/// @file math.hpp
+///
+/// @brief Scalar and array formulas shared by the TMB models and the `.Call`
+/// routines of `SpatialGEV`.
+///
+/// Only depends on Eigen, so that it can be included both by the TMB models
+/// (via `utils.hpp`) and by the main package library.
+
+#ifndef SPATIALGEV_MATH_HPP
+#define SPATIALGEV_MATH_HPP
+
+#include <cmath>
+#include <Eigen/Dense>
+
+namespace SpatialGEV {
+
+  /// Order of the closed-form Matern correlation for half-integer smoothness.
+  ///
+  /// @param[in] nu Smoothness parameter of the Matern.
+  ///
+  /// @return `2*nu` if `nu` is one of 0.5, 1.5, or 2.5 up to a relative
+  /// tolerance of `1e-8`, and 0 otherwise.  Used to dispatch `nu` once to the
+  /// compile-time `NU2` of `matern_cor()` and its callers.
+  inline int matern_half_order(const double nu) {
+    double nu2 = 2.0 * nu;
+    for (int k = 1; k <= 5; k += 2) {
+      if (std::fabs(nu2 - k) <= 1e-8 * k) return k;
+    }
+    return 0;
+  }
+
+  /// Elementwise Matern correlation in closed form for half-integer smoothness.
+  ///
+  /// Array version of `matern_cor()` for `NU2` one of 1, 3, or 5, evaluated as
+  /// a single Eigen expression.
+  ///
+  /// @tparam NU2 Twice the smoothness parameter.
+  /// @param[in] r Array of distances times the inverse range parameter `kappa`.
+  template <int NU2, class Derived>
+  Eigen::Array<typename Derived::Scalar, Eigen::Dynamic, Eigen::Dynamic>
+  matern_half_array(const Eigen::ArrayBase<Derived>& r) {
+    typedef typename Derived::Scalar Type;
+    if (NU2 == 1) return (-r).exp();
+    if (NU2 == 3) return (Type(1.0) + r) * (-r).exp();
+    return (Type(1.0) + r + r.square() / Type(3.0)) * (-r).exp();
+  }
+
+  /// Transform the GEV shape parameter to its natural scale.
+  ///
+  /// @param[in] s GEV Shape parameter on the scale specified by `reparam_s`.
+  /// @param[in] reparam_s Flag indicating reparametrization of s. 1: `s` is
+  /// `log(s)`, 2: `s` is `log(-s)`, anything else: `s` is unconstrained.
+  ///
+  /// @return The shape parameter on its natural scale.
+  template <class Type>
+  Type gev_reparam_shape(const Type s, const int reparam_s) {
+    using std::exp;
+    if (reparam_s == 1) { // s is constrained to be positive, i.e., we are optimizing log(s)
+      return exp(s);
+    } else if (reparam_s == 2) { // s is constrained to be negative, i.e., we are optimizing log(-s)
+      return -exp(s);
+    }
+    return s; // no reparametrization, s is unconstrained
+  }
+
+  /// Transform the GEV shape parameter to its natural scale, with
+  /// compile-time reparametrization.
+  ///
+  /// @tparam reparam_s Flag indicating reparametrization of s, as in
+  /// `gev_reparam_shape(s, reparam_s)`.
+  /// @param[in] s GEV Shape parameter on the scale specified by `reparam_s`.
+  template <int reparam_s, class Type>
+  Type gev_reparam_shape(const Type s) {
+    using std::exp;
+    if (reparam_s == 1) return exp(s);
+    if (reparam_s == 2) return -exp(s);
+    return s;
+  }
+
+  /// Quantile function of the GEV distribution.
+  ///
+  /// With `y = -log(p)`, the quantile is `a + (b/s) (y^{-s} - 1)`, or `a - b
+  /// log(y)` for the Gumbel distribution.  This is the only implementation of
+  /// the quantile function, used for the return levels of the models and for
+  /// the random draws by inversion of the CDF.
+  ///
+  /// @param[in] p Probability.
+  /// @param[in] a GEV Location parameter.
+  /// @param[in] log_b GEV (log) scale parameter.
+  /// @param[in] s GEV Shape parameter on its natural scale.  Values of `|s|
+  /// <= 1e-7` use the Gumbel quantile, as in `gev_lpdf()`.
+  /// @param[in] gumbel Whether to use the Gumbel quantile, in which case `s` is
+  /// ignored.
+  template <class Type>
+  Type gev_quantile(const Type p, const Type a, const Type log_b,
+		    const Type s, const bool gumbel) {
+    using std::exp;
+    using std::log;
+    using std::pow;
+    using std::fabs;
+    Type y = -log(p);
+    if (gumbel || fabs(s) <= 1e-7) return a - exp(log_b) * log(y);
+    return a + (exp(log_b)/s) * (pow(y, -s) - Type(1.0));
+  }
+
+} // end namespace SpatialGEV
+
+#endif
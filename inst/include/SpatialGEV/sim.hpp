@@ -0,0 +1,528 @@
+/// @file sim.hpp
+///
+/// @brief Double precision simulation routines of `SpatialGEV`.
+///
+/// These are called from the `.Call` entry points of the main package library
+/// rather than from the TMB models, since they do not need automatic
+/// differentiation.  Random numbers are drawn from the R random number
+/// generator, so the caller must bracket them by `GetRNGstate()` and
+/// `PutRNGstate()`.  Errors are reported by throwing `std::runtime_error`.
+
+#ifndef SPATIALGEV_SIM_HPP
+#define SPATIALGEV_SIM_HPP
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#ifndef R_NO_REMAP
+#define R_NO_REMAP
+#endif
+#include <R.h>
+#include <Rmath.h>
+#include "math.hpp"
+
+namespace SpatialGEV {
+
+  /// @typedef
+  /// @brief Typedefs for read-only double precision arguments.
+  typedef Eigen::Ref<const Eigen::MatrixXd> cRefMatrixXd_t;
+  typedef Eigen::Ref<const Eigen::VectorXd> cRefVectorXd_t;
+
+  /// Matern correlation function for general smoothness.
+  ///
+  /// @param[in] r Distance times the inverse range parameter `kappa`.
+  /// @param[in] nu Smoothness parameter of the Matern.
+  ///
+  /// @return The Matern correlation, which is 1 at `r = 0`.  Calls the Bessel
+  /// function of R, so it must not be used in parallel regions.
+  inline double matern_cor_bessel(const double r, const double nu) {
+    if (r <= 0.0) return 1.0;
+    return std::pow(r, nu) * bessel_k(r, nu, 1.0) /
+      (gammafn(nu) * std::pow(2.0, nu - 1.0));
+  }
+
+  /// Error for a correlation matrix of the observed locations which is not
+  /// positive definite, e.g., because of duplicated locations.
+  inline void throw_obs_not_pd() {
+    throw std::runtime_error("Correlation matrix of the observed locations is not positive definite.  Check for duplicated locations.");
+  }
+
+  /// Euclidean distances between two sets of locations.
+  ///
+  /// @param[in] X1 Matrix of size `n1 x d` of coordinates.
+  /// @param[in] X2 Matrix of size `n2 x d` of coordinates.
+  ///
+  /// @return Matrix of size `n1 x n2` of distances.
+  inline Eigen::MatrixXd dist_cross(const Eigen::MatrixXd& X1,
+				    const Eigen::MatrixXd& X2) {
+    Eigen::MatrixXd dist(X1.rows(), X2.rows());
+    for (int j = 0; j < X2.rows(); j++) {
+      for (int i = 0; i < X1.rows(); i++) {
+	dist(i,j) = sqrt((X1.row(i) - X2.row(j)).squaredNorm());
+      }
+    }
+    return dist;
+  }
+
+  /// Correlations at a (not necessarily square) matrix of distances.
+  ///
+  /// @param[out] cov Matrix into which to store the output.
+  /// @param[in] dist_mat Matrix of distances.
+  /// @param[in] kernel 0 for the exponential kernel, 1 for the Matern.
+  /// @param[in] range Range parameter `ell` of the exponential, or inverse
+  /// range parameter `kappa` of the Matern.
+  /// @param[in] nu Smoothness parameter of the Matern.
+  inline void cov_cross(Eigen::Ref<Eigen::MatrixXd> cov,
+			const Eigen::Ref<const Eigen::MatrixXd>& dist_mat,
+			const int kernel, const double range, const double nu) {
+    if (kernel == 0) {
+      cov = (-dist_mat.array() / range).exp().matrix();
+      return;
+    }
+    switch (matern_half_order(nu)) {
+    case 1:
+      cov = matern_half_array<1>(range * dist_mat.array()).matrix();
+      return;
+    case 3:
+      cov = matern_half_array<3>(range * dist_mat.array()).matrix();
+      return;
+    case 5:
+      cov = matern_half_array<5>(range * dist_mat.array()).matrix();
+      return;
+    }
+    for (int j = 0; j < dist_mat.cols(); j++) {
+      for (int i = 0; i < dist_mat.rows(); i++) {
+	cov(i,j) = matern_cor_bessel(range * dist_mat(i,j), nu);
+      }
+    }
+    return;
+  }
+
+  /// Pivoted Cholesky approximation of a conditional correlation matrix.
+  ///
+  /// Computes a low rank plus diagonal approximation `L L^T + diag(d)` of the
+  /// conditional correlation `C = R_nn - R_no W`, where `R` are the
+  /// correlations between new (`n`) and observed (`o`) locations and `W` the
+  /// kriging weights.  The pivoted Cholesky decomposition stops when the rank
+  /// reaches `max_rank` or the trace of the residual `C - L L^T` drops below
+  /// `rank_tol` times the trace of `C`.  The diagonal `d` is that of the
+  /// residual, so that the approximation has the exact diagonal of `C`.  Only
+  /// the diagonal and the pivot columns of `C` are computed, so that the
+  /// memory is `O(n_new * max_rank)` and the cost `O(n_new * max_rank *
+  /// (n_obs + max_rank))`.
+  ///
+  /// @param[out] L Matrix of size `n_new x rank` of the low-rank factor.
+  /// @param[out] d Vector of length `n_new` of residual variances.
+  /// @param[in] X_new Matrix of size `n_new x 2` of new locations.
+  /// @param[in] cor_no Matrix of size `n_new x n_obs` of correlations between
+  /// new and observed locations.
+  /// @param[in] W Matrix of size `n_obs x n_new` of kriging weights.
+  /// @param[in] kernel 0 for the exponential kernel, 1 for the Matern.
+  /// @param[in] range Range parameter (see `cov_cross()`).
+  /// @param[in] nu Smoothness parameter of the Matern.
+  /// @param[in] max_rank Maximum rank of the approximation.
+  /// @param[in] rank_tol Relative tolerance on the trace of the residual.
+  inline void cond_cor_lowrank(Eigen::MatrixXd& L, Eigen::VectorXd& d,
+			       const Eigen::MatrixXd& X_new,
+			       const Eigen::MatrixXd& cor_no,
+			       const Eigen::MatrixXd& W,
+			       const int kernel, const double range,
+			       const double nu, const int max_rank,
+			       const double rank_tol) {
+    int n_new = X_new.rows();
+    int max_r = std::min(max_rank, n_new);
+    d = (Eigen::VectorXd::Ones(n_new) -
+	 (cor_no.transpose().array() * W.array()).colwise().sum().matrix().transpose())
+      .cwiseMax(0.0);
+    double trace0 = d.sum();
+    L.resize(n_new, max_r);
+    Eigen::MatrixXd dist_i(n_new, 1), cor_i(n_new, 1);
+    int rank = 0;
+    while (rank < max_r && d.sum() > rank_tol * trace0) {
+      int i;
+      double pivot = d.maxCoeff(&i);
+      if (pivot <= 0.0) break;
+      // column i of the conditional correlation
+      dist_i = (X_new.rowwise() - X_new.row(i)).rowwise().norm();
+      cov_cross(cor_i, dist_i, kernel, range, nu);
+      Eigen::VectorXd col = cor_i.col(0) - cor_no * W.col(i);
+      if (rank > 0) col -= L.leftCols(rank) * L.row(i).head(rank).transpose();
+      L.col(rank) = col / sqrt(pivot);
+      d -= L.col(rank).cwiseAbs2();
+      d(i) = 0.0;
+      d = d.cwiseMax(0.0);
+      rank++;
+    }
+    L.conservativeResize(n_new, rank);
+    return;
+  }
+
+  /// Conditional simulation of a Gaussian process at new locations.
+  ///
+  /// For each draw `k` of the GP parameters, simulates the GP at the new
+  /// locations conditional on its values at the observed locations, where the
+  /// GP has mean `mean_new(,k)` and `mean_obs(,k)` at the new and observed
+  /// locations, scale parameter `sigma(k)` and range parameter `range(k)`.
+  ///
+  /// Since the correlations only depend on the range parameter, the draws are
+  /// grouped by its value, and the kriging weights and the factorization of
+  /// the conditional correlation matrix are computed once per group.  The
+  /// distances between locations are computed once for all draws.
+  ///
+  /// If `max_rank > 0`, the conditional correlation is replaced by its low
+  /// rank plus diagonal approximation computed by `cond_cor_lowrank()`, such
+  /// that neither it nor the correlations between new locations are stored.
+  ///
+  /// The computations are done in double precision, with standard normals
+  /// drawn from the R random number generator.
+  ///
+  /// @param[in] locs_obs Matrix of size `n_obs x 2` of observed locations.
+  /// @param[in] locs_new Matrix of size `n_new x 2` of new locations.
+  /// @param[in] kernel 0 for the exponential kernel, 1 for the Matern.
+  /// @param[in] nu Smoothness parameter of the Matern.
+  /// @param[in] field_obs Matrix of size `n_obs x n_draw` of GP values at the
+  /// observed locations.
+  /// @param[in] mean_obs Matrix of size `n_obs x n_draw` of GP means at the
+  /// observed locations.
+  /// @param[in] mean_new Matrix of size `n_new x n_draw` of GP means at the
+  /// new locations.
+  /// @param[in] sigma Vector of length `n_draw` of scale parameters.
+  /// @param[in] range Vector of length `n_draw` of range parameters (see
+  /// `cov_cross()`).
+  /// @param[in] max_rank Maximum rank of the approximation of the conditional
+  /// correlation, or 0 for the exact conditional correlation.
+  /// @param[in] rank_tol Relative tolerance of the approximation.
+  ///
+  /// @return Matrix of size `n_new x n_draw` of GP values at the new locations.
+  inline Eigen::MatrixXd gp_cond_sim(const cRefMatrixXd_t& locs_obs,
+				     const cRefMatrixXd_t& locs_new,
+				     const int kernel, const double nu,
+				     const cRefMatrixXd_t& field_obs,
+				     const cRefMatrixXd_t& mean_obs,
+				     const cRefMatrixXd_t& mean_new,
+				     const cRefVectorXd_t& sigma,
+				     const cRefVectorXd_t& range,
+				     const int max_rank = 0,
+				     const double rank_tol = 0.0) {
+    typedef Eigen::MatrixXd MatrixXd;
+    typedef Eigen::VectorXd VectorXd;
+    int n_obs = locs_obs.rows();
+    int n_new = locs_new.rows();
+    int n_draw = sigma.size();
+    MatrixXd X_obs = locs_obs;
+    MatrixXd X_new = locs_new;
+    MatrixXd dist_oo = dist_cross(X_obs, X_obs);
+    MatrixXd dist_no = dist_cross(X_new, X_obs);
+    bool low_rank = max_rank > 0;
+    MatrixXd dist_nn;
+    if (!low_rank) dist_nn = dist_cross(X_new, X_new);
+    MatrixXd resid = field_obs - mean_obs;
+    MatrixXd field_new = mean_new;
+    // group the draws by range parameter
+    std::vector<int> order(n_draw);
+    for (int k = 0; k < n_draw; k++) order[k] = k;
+    std::stable_sort(order.begin(), order.end(), [&range](int i, int j) {
+      return range(i) < range(j);
+    });
+    MatrixXd cor_oo(n_obs, n_obs), cor_no(n_new, n_obs), cor_nn;
+    if (!low_rank) cor_nn.resize(n_new, n_new);
+    for (int start = 0; start < n_draw; ) {
+      double range_ = range(order[start]);
+      int end = start + 1;
+      while (end < n_draw && range(order[end]) == range_) end++;
+      int n_group = end - start;
+      cov_cross(cor_oo, dist_oo, kernel, range_, nu);
+      cov_cross(cor_no, dist_no, kernel, range_, nu);
+      // kriging weights W = cor_oo^{-1} cor_on
+      Eigen::LLT<MatrixXd> llt_oo(cor_oo);
+      if (llt_oo.info() != Eigen::Success) throw_obs_not_pd();
+      MatrixXd W = llt_oo.solve(cor_no.transpose());
+      MatrixXd z;
+      if (low_rank) {
+	// z = L z1 + sqrt(d) z2
+	MatrixXd L;
+	VectorXd d;
+	cond_cor_lowrank(L, d, X_new, cor_no, W, kernel, range_, nu,
+			 max_rank, rank_tol);
+	MatrixXd z1(L.cols(), n_group);
+	for (int k = 0; k < n_group; k++) {
+	  for (int i = 0; i < L.cols(); i++) z1(i,k) = norm_rand();
+	}
+	z.resize(n_new, n_group);
+	for (int k = 0; k < n_group; k++) {
+	  for (int i = 0; i < n_new; i++) z(i,k) = norm_rand();
+	}
+	z = d.cwiseSqrt().asDiagonal() * z;
+	z += L * z1;
+      } else {
+	cov_cross(cor_nn, dist_nn, kernel, range_, nu);
+	// conditional correlation, which is only positive semi-definite if
+	// some of the new locations coincide with observed ones
+	MatrixXd cor_cond = cor_nn - cor_no * W;
+	Eigen::LDLT<MatrixXd> ldlt_cond(cor_cond);
+	VectorXd sqrt_d = ldlt_cond.vectorD().cwiseMax(0.0).cwiseSqrt();
+	// standard normals for all draws of the group
+	z.resize(n_new, n_group);
+	for (int k = 0; k < n_group; k++) {
+	  for (int i = 0; i < n_new; i++) z(i,k) = norm_rand();
+	}
+	z = sqrt_d.asDiagonal() * z;
+	z = ldlt_cond.matrixL() * z;
+	z = ldlt_cond.transpositionsP().transpose() * z;
+      }
+      MatrixXd resid_group(n_obs, n_group);
+      for (int k = 0; k < n_group; k++) resid_group.col(k) = resid.col(order[start + k]);
+      MatrixXd krige = W.transpose() * resid_group;
+      for (int k = 0; k < n_group; k++) {
+	int kk = order[start + k];
+	field_new.col(kk) += krige.col(k) + sigma(kk) * z.col(k);
+      }
+      start = end;
+    }
+    return field_new;
+  }
+
+  /// Marginal conditional simulation of a Gaussian process at new locations.
+  ///
+  /// Same as `gp_cond_sim()`, except that the GP is simulated independently at
+  /// each new location from its marginal conditional distribution, such that
+  /// only the diagonal of the conditional covariance is needed.  The new
+  /// locations are processed in tiles of `tile_size`, for which only the
+  /// correlations with the observed locations are stored, so that the cost is
+  /// linear in the number of new locations and the memory `O(n_obs *
+  /// tile_size)` per thread.  With OpenMP, the tiles are processed in
+  /// parallel by `n_threads` threads.  Since the standard normals are drawn
+  /// from the (not thread safe) R random number generator, they are all drawn
+  /// before the parallel loop.  Likewise, the Bessel function used for general
+  /// Matern smoothness calls R, in which case a single thread is used.
+  ///
+  /// @param[in] locs_obs Matrix of size `n_obs x 2` of observed locations.
+  /// @param[in] locs_new Matrix of size `n_new x 2` of new locations.
+  /// @param[in] kernel 0 for the exponential kernel, 1 for the Matern.
+  /// @param[in] nu Smoothness parameter of the Matern.
+  /// @param[in] field_obs Matrix of size `n_obs x n_draw` of GP values at the
+  /// observed locations.
+  /// @param[in] mean_obs Matrix of size `n_obs x n_draw` of GP means at the
+  /// observed locations.
+  /// @param[in] mean_new Matrix of size `n_new x n_draw` of GP means at the
+  /// new locations.
+  /// @param[in] sigma Vector of length `n_draw` of scale parameters.
+  /// @param[in] range Vector of length `n_draw` of range parameters (see
+  /// `cov_cross()`).
+  /// @param[in] tile_size Number of new locations per tile.
+  /// @param[in] n_threads Number of OpenMP threads.
+  ///
+  /// @return Matrix of size `n_new x n_draw` of GP values at the new locations.
+  inline Eigen::MatrixXd gp_cond_sim_marginal(const cRefMatrixXd_t& locs_obs,
+					      const cRefMatrixXd_t& locs_new,
+					      const int kernel, const double nu,
+					      const cRefMatrixXd_t& field_obs,
+					      const cRefMatrixXd_t& mean_obs,
+					      const cRefMatrixXd_t& mean_new,
+					      const cRefVectorXd_t& sigma,
+					      const cRefVectorXd_t& range,
+					      const int tile_size,
+					      const int n_threads) {
+    typedef Eigen::MatrixXd MatrixXd;
+    typedef Eigen::VectorXd VectorXd;
+    int n_obs = locs_obs.rows();
+    int n_new = locs_new.rows();
+    int n_draw = sigma.size();
+    int n_tile = (n_new + tile_size - 1) / tile_size;
+    MatrixXd X_obs = locs_obs;
+    MatrixXd X_new = locs_new;
+    MatrixXd dist_oo = dist_cross(X_obs, X_obs);
+    MatrixXd resid = field_obs - mean_obs;
+    MatrixXd field_new = mean_new;
+    int n_thread_used = (kernel == 0 || matern_half_order(nu) > 0) ? n_threads : 1;
+    // standard normals, drawn before the parallel loop
+    MatrixXd z(n_new, n_draw);
+    for (int k = 0; k < n_draw; k++) {
+      for (int i = 0; i < n_new; i++) z(i,k) = norm_rand();
+    }
+    // group the draws by range parameter
+    std::vector<int> order(n_draw);
+    for (int k = 0; k < n_draw; k++) order[k] = k;
+    std::stable_sort(order.begin(), order.end(), [&range](int i, int j) {
+      return range(i) < range(j);
+    });
+    MatrixXd cor_oo(n_obs, n_obs);
+    for (int start = 0; start < n_draw; ) {
+      double range_ = range(order[start]);
+      int end = start + 1;
+      while (end < n_draw && range(order[end]) == range_) end++;
+      int n_group = end - start;
+      cov_cross(cor_oo, dist_oo, kernel, range_, nu);
+      Eigen::LLT<MatrixXd> llt_oo(cor_oo);
+      if (llt_oo.info() != Eigen::Success) throw_obs_not_pd();
+      // cor_oo^{-1} (field_obs - mean_obs), so that the conditional mean of
+      // each tile is its correlation with the observed locations times alpha
+      MatrixXd alpha(n_obs, n_group);
+      for (int k = 0; k < n_group; k++) alpha.col(k) = resid.col(order[start + k]);
+      alpha = llt_oo.solve(alpha);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(n_thread_used) schedule(dynamic)
+#endif
+      for (int t = 0; t < n_tile; t++) {
+	int i0 = t * tile_size;
+	int n_t = std::min(tile_size, n_new - i0);
+	MatrixXd X_tile = X_new.middleRows(i0, n_t);
+	MatrixXd dist_to = dist_cross(X_tile, X_obs);
+	MatrixXd cor_to(n_t, n_obs);
+	cov_cross(cor_to, dist_to, kernel, range_, nu);
+	MatrixXd W = llt_oo.solve(cor_to.transpose());
+	VectorXd sd = (VectorXd::Ones(n_t) -
+		       (cor_to.transpose().array() * W.array()).colwise().sum()
+		       .matrix().transpose()).cwiseMax(0.0).cwiseSqrt();
+	MatrixXd krige = cor_to * alpha;
+	for (int k = 0; k < n_group; k++) {
+	  int kk = order[start + k];
+	  field_new.col(kk).segment(i0, n_t) += krige.col(k) +
+	    sigma(kk) * sd.cwiseProduct(z.col(kk).segment(i0, n_t));
+	}
+      }
+      start = end;
+    }
+    (void) n_thread_used;
+    return field_new;
+  }
+
+  /// Random draws from the GEV distribution based on different parameterizations of s.
+  ///
+  /// Each draw is obtained by inversion of the CDF, i.e., by evaluating
+  /// `gev_quantile()` at a uniform draw from the R random number generator,
+  /// such that the draws are reproducible with `set.seed()`.
+  ///
+  /// @param[out] y Vector of draws.
+  /// @param[in] a Vector of GEV location parameters, of the same length as `y`.
+  /// @param[in] log_b Vector of GEV (log) scale parameters.
+  /// @param[in] s Vector of GEV shape parameters (possibly transformed).
+  /// Ignored if `reparam_s = 0`.  Draws with `|s| <= 1e-7` on the natural
+  /// scale are from the Gumbel distribution.
+  /// @param[in] reparam_s Flag indicating reparametrization of s.
+  inline void gev_reparam_rand(Eigen::Ref<Eigen::VectorXd> y,
+			       const cRefVectorXd_t& a,
+			       const cRefVectorXd_t& log_b,
+			       const cRefVectorXd_t& s,
+			       const int reparam_s) {
+    bool gumbel = reparam_s == 0;
+    for (int i = 0; i < y.size(); i++) {
+      double _s = gumbel ? 0.0 : gev_reparam_shape<double>(s(i), reparam_s);
+      y(i) = gev_quantile<double>(unif_rand(), a(i), log_b(i), _s, gumbel);
+    }
+    return;
+  }
+
+  /// Draws from a multivariate normal with sparse precision matrix, given its
+  /// Cholesky factor.
+  ///
+  /// With `P Q P^T = L L^T`, each draw is `x = mean + P^T L^{-T} z`, for `z` a
+  /// vector of standard normals.  The draws are split into blocks of
+  /// `block_size` columns, and the triangular solves for each block are run
+  /// in parallel by `n_threads` OpenMP threads.  Each block has its own
+  /// `std::mt19937_64` stream of standard normals, seeded from the (not
+  /// thread safe) R random number generator before the parallel loop, so that
+  /// the draws are reproducible with `set.seed()` and do not depend on the
+  /// number of threads.
+  ///
+  /// @param[in] L Sparse lower triangular Cholesky factor of size `d x d`.
+  /// @param[in] perm Vector of length `d` of 0-based fill-reducing permutation,
+  /// i.e., `(P x)(i) = x(perm(i))`.
+  /// @param[in] mean Mean vector of length `d`.
+  /// @param[in] n_draw Number of draws.
+  /// @param[in] block_size Number of draws per block.
+  /// @param[in] n_threads Number of OpenMP threads.
+  ///
+  /// @return Matrix of size `d x n_draw`, each column of which is a draw.
+  inline Eigen::MatrixXd rmvn_chol_sim(const Eigen::SparseMatrix<double>& L,
+				       const Eigen::Ref<const Eigen::VectorXi>& perm,
+				       const cRefVectorXd_t& mean,
+				       const int n_draw, const int block_size,
+				       const int n_threads) {
+    typedef Eigen::MatrixXd MatrixXd;
+    int d = L.rows();
+    int n_block = (n_draw + block_size - 1) / block_size;
+    // transpose of the factor, stored column-wise for the backward solves
+    Eigen::SparseMatrix<double> Lt = L.transpose();
+    // one seed per block, drawn before the parallel loop
+    std::vector<unsigned long long> seed(n_block);
+    for (int b = 0; b < n_block; b++) {
+      unsigned long long hi = unif_rand() * 4294967296.0;
+      unsigned long long lo = unif_rand() * 4294967296.0;
+      seed[b] = (hi << 32) ^ lo;
+    }
+    MatrixXd x(d, n_draw);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(n_threads) schedule(dynamic)
+#endif
+    for (int b = 0; b < n_block; b++) {
+      int k0 = b * block_size;
+      int n_b = std::min(block_size, n_draw - k0);
+      std::mt19937_64 engine(seed[b]);
+      std::normal_distribution<double> norm(0.0, 1.0);
+      MatrixXd z(d, n_b);
+      for (int k = 0; k < n_b; k++) {
+	for (int i = 0; i < d; i++) z(i,k) = norm(engine);
+      }
+      Lt.triangularView<Eigen::Upper>().solveInPlace(z);
+      for (int i = 0; i < d; i++) {
+	int ii = perm(i);
+	double mu = mean(ii);
+	for (int k = 0; k < n_b; k++) x(ii, k0 + k) = z(i,k) + mu;
+      }
+    }
+    (void) n_threads;
+    return x;
+  }
+  /// Return levels and their gradients with respect to the GEV parameters.
+  ///
+  /// Each return level only depends on the GEV parameters at its own location.
+  /// The quantiles are computed by `gev_quantile()`, and their derivatives in
+  /// closed form.  With `y = -log(p)` and `xi` the shape parameter on its
+  /// natural scale, the quantile is `z = a + (b/xi) (y^{-xi} - 1)`, such that
+  /// `dz/da = 1`, `dz/dlog_b = z - a` and `dz/dxi = -(b/xi^2) (y^{-xi} - 1) -
+  /// (b/xi) log(y) y^{-xi}`, which is then multiplied by the derivative of the
+  /// shape transformation.  For the Gumbel quantile `z = a - b log(y)`,
+  /// `dz/dxi` is its limit `b log(y)^2 / 2` as `xi -> 0`, or 0 if `reparam_s =
+  /// 0`.
+  ///
+  /// @param[out] quant Vector of quantiles to compute.
+  /// @param[out] jac Matrix of size `n_prob x 3` of derivatives of `quant` with
+  /// respect to `a`, `log_b` and `s`.
+  /// @param[in] prob Vector of probabilities at which to compute the quantiles.
+  /// @param[in] a GEV Location parameter.
+  /// @param[in] log_b GEV (log) scale parameter.
+  /// @param[in] s GEV Shape parameter (possibly transformed).
+  /// @param[in] reparam_s Flag indicating reparametrization of s.
+  inline void gev_reparam_quantile_jac(Eigen::Ref<Eigen::VectorXd> quant,
+				       Eigen::Ref<Eigen::MatrixXd> jac,
+				       const cRefVectorXd_t& prob, const double a,
+				       const double log_b, const double s,
+				       const int reparam_s) {
+    bool gumbel = reparam_s == 0;
+    double _b = std::exp(log_b);
+    double _s = gumbel ? 0.0 : gev_reparam_shape<double>(s, reparam_s);
+    double ds = (reparam_s == 1 || reparam_s == 2) ? _s : 1.0;
+    for (int i = 0; i < prob.size(); i++) {
+      quant(i) = gev_quantile<double>(prob(i), a, log_b, _s, gumbel);
+      double log_y = std::log(-std::log(prob(i)));
+      if (gumbel) {
+	jac(i,2) = 0.0;
+      } else if (std::fabs(_s) <= 1e-7) {
+	jac(i,2) = 0.5 * _b * log_y * log_y * ds;
+      } else {
+	double y_pow = std::exp(-_s * log_y);
+	jac(i,2) = ((-_b/(_s*_s)) * (y_pow - 1.0) -
+		    (_b/_s) * log_y * y_pow) * ds;
+      }
+      jac(i,0) = 1.0;
+      jac(i,1) = quant(i) - a;
+    }
+    return;
+  }
+} // end namespace SpatialGEV
+
+#endif
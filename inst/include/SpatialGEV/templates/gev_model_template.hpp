@@ -1,5 +1,5 @@
-#ifndef model_{{random_effects}}_{{kernel}}_hpp
-#define model_{{random_effects}}_{{kernel}}_hpp
+#ifndef model_{{random_effects}}_{{kernel}}{{model_suffix}}_hpp
+#define model_{{random_effects}}_{{kernel}}{{model_suffix}}_hpp
 
 #include "SpatialGEV/utils.hpp"
 
@@ -12,15 +12,30 @@
 ///
 /// y ~ GEV(a, b, s),
 {{#re_names}}
+{{^share_range}}
 /// {{long_name}} ~ GP({{gp_hyperparam1}}_{{short_name}}, {{gp_hyperparam2}}_{{short_name}})
+{{/share_range}}
+{{#share_range}}
+/// {{long_name}} ~ GP({{gp_hyperparam1}}_{{short_name}}, {{gp_hyperparam2}})
+{{/share_range}}
 {{/re_names}}
 /// where the GP is parameterized using the {{kernel}} covariance kernel.
+{{#share_range}}
+/// The range parameter is shared by all GPs, so that their common correlation
+/// matrix is computed and factorized only once.
+{{/share_range}}
 ///
 /// --------- Data provided from R ---------------
 /// @param[in] y Response vector of length `n_obs`.  Assumed to be > 0.
 /// @param[in] loc_ind Location vector of length `n_obs` of integers
 /// `0 <= i_loc < n_loc` indicating to which locations each element of `y` is
-/// associated.
+/// associated.  For the grouped layout (see `obs_offset`), a vector of length
+/// `n_group` giving the location of each group of observations instead.
+/// @param[in] obs_offset CSR-style offsets for the grouped data layout: `y` is
+/// sorted by location and the observations of group `i` are
+/// `y[obs_offset(i):(obs_offset(i+1)-1)]`, so this is a vector of length
+/// `n_group + 1`.  If of length 1, each element of `y` is instead associated
+/// with its own entry of `loc_ind`.
 /// @param[in] reparam_s Integer indicating the type of shape parameter. 0:
 /// `s = 0`, i.e., use Gumbel instead of GEV distribution.  1: `s > 0`, in which
 /// case we operate on `log(s)`.  2: `s < 0`, in which case we operate on
@@ -35,12 +50,30 @@
 /// @param[in] spde Object of type `spde_t` as constructed in R by a call to
 /// [INLA::inla.spde2.matern()] consisting of `n_loc` mesh locations.
 {{/use_spde}}
-{{^use_spde}}
+{{#use_dist}}
 /// @param[in] dist_mat `n_loc x n_loc` distance matrix typically constructed
 /// via `stats::dist(coordinates)`.
+/// In sparse mode (see `sp_thres`), a `0 x 0` matrix.
 /// @param[in] sp_thres Scalar number used to make the covariance matrix sparse
-/// by thresholding. If sp_thres=-1, no thresholding is made.
-{{/use_spde}}
+/// by thresholding. If sp_thres=-1, no thresholding is made.  Otherwise the
+/// GP log-density is computed in sparse mode from `sp_nb` and `sp_dist`.
+/// @param[in] sp_taper Integer flag.  In sparse mode, 1 to multiply the
+/// correlations by a Wendland taper with support `sp_thres`, which keeps the
+/// correlation matrix positive definite, or 0 to set the correlations beyond
+/// `sp_thres` to zero.
+/// @param[in] sp_nb Integer matrix of size `n_pair x 2`, each row of which
+/// contains the (0-based) indices `i > j` of a pair of locations at distance
+/// less than `sp_thres`.
+/// @param[in] sp_dist Vector of length `n_pair` of distances between the pairs
+/// of locations in `sp_nb`.
+{{/use_dist}}
+{{#use_nngp}}
+/// @param[in] nn_ind Integer matrix of size `n_loc x m` of (0-based) indices
+/// of the nearest neighbours of each location among the preceding ones, padded
+/// with -1.
+/// @param[in] nn_dist Array of size `(m+1) x (m+1) x n_loc` of distances
+/// between each location and its nearest neighbours.
+{{/use_nngp}}
 {{#re_names}}
 /// @param[in] design_mat_{{short_name}} Design matrix of size
 /// `n_loc x n_covariate` for parameter {{long_name}}.
@@ -96,11 +129,21 @@
 /// length `n_covariate` for {{long_name}}.
 /// @param[in] {{gp_hyperparam1}}_{{short_name}} GP covariance kernel variance
 /// hyperparameter for {{long_name}}.
+{{^share_range}}
 /// @param[in] {{gp_hyperparam2}}_{{short_name}} GP covariance kernel range
 /// hyperparameter for {{long_name}}.
+{{/share_range}}
 {{/re_names}}
-template<class Type>
-Type model_{{random_effects}}_{{kernel}}(objective_function<Type>* obj){
+{{#share_range}}
+/// @param[in] {{gp_hyperparam2}} GP covariance kernel range hyperparameter
+/// shared by all random effects.
+{{/share_range}}
+///
+/// The parametrization of s is a template parameter, such that the data layer
+/// compiles without branches.  The model is called via
+/// `model_{{random_effects}}_{{kernel}}{{model_suffix}}()`, which dispatches `reparam_s` once.
+template<class Type, int reparam_s>
+Type model_{{random_effects}}_{{kernel}}{{model_suffix}}_t(objective_function<Type>* obj){
   using namespace density;
   using namespace R_inla;
   using namespace Eigen;
@@ -109,7 +152,7 @@ Type model_{{random_effects}}_{{kernel}}(objective_function<Type>* obj){
   // ------ Data inputs ------------
   DATA_VECTOR(y);
   DATA_IVECTOR(loc_ind);
-  DATA_INTEGER(reparam_s);
+  DATA_IVECTOR(obs_offset);
   DATA_INTEGER(beta_prior);
   DATA_VECTOR(return_periods);
   int has_returns = return_periods(0) > Type(0.0);
@@ -117,11 +160,17 @@ Type model_{{random_effects}}_{{kernel}}(objective_function<Type>* obj){
   DATA_STRUCT(spde, spde_t);
   int n_loc = spde.M0.rows(); // number of spatial locations
   {{/use_spde}}
-  {{^use_spde}}
+  {{#use_dist}}
   DATA_MATRIX(dist_mat);
   DATA_SCALAR(sp_thres);
-  int n_loc = dist_mat.rows(); // number of spatial dimensions
-  {{/use_spde}}
+  DATA_INTEGER(sp_taper);
+  DATA_IMATRIX(sp_nb);
+  DATA_VECTOR(sp_dist);
+  {{/use_dist}}
+  {{#use_nngp}}
+  DATA_IMATRIX(nn_ind);
+  DATA_ARRAY(nn_dist);
+  {{/use_nngp}}
   {{#use_matern}}
   DATA_SCALAR(nu);
   {{/use_matern}}
@@ -140,6 +189,9 @@ Type model_{{random_effects}}_{{kernel}}(objective_function<Type>* obj){
   DATA_SCALAR(s_mean);
   DATA_SCALAR(s_sd);
   {{/is_random_s}}
+  {{^use_spde}}
+  int n_loc = design_mat_a.rows(); // number of spatial locations
+  {{/use_spde}}
 
   // ------------ Parameters ----------------------
 
@@ -152,41 +204,88 @@ Type model_{{random_effects}}_{{kernel}}(objective_function<Type>* obj){
   {{/re_names}}
   {{#re_names}}
   PARAMETER({{gp_hyperparam1}}_{{short_name}});
+  {{^share_range}}
   PARAMETER({{gp_hyperparam2}}_{{short_name}});
+  {{/share_range}}
   {{/re_names}}
+  {{#share_range}}
+  PARAMETER({{gp_hyperparam2}});
+  {{/share_range}}
 
-  // Initialize the negative log likelihood
+  // Initialize the negative log likelihood.  Each contribution to it is
+  // computed in a PARALLEL_REGION: with TMB::openmp(n_threads), the regions are
+  // distributed over the tapes of the threads, whose outputs are summed by TMB.
   Type nll = Type(0.0);
+  {{#share_range}}
+
+  // Correlation matrix shared by all GPs, factorized once, so that the GPs are
+  // in the same parallel region
+  PARALLEL_REGION {
+  gp_mvnorm_t<Type> gp_shared;
+  gp_factor_{{kernel}}<Type>(gp_shared, n_loc, {{nlpdf_gp_distance}},
+			     exp({{gp_hyperparam2}}), {{nlpdf_gp_extra}});
+  {{#use_matern}}
+  // PC prior on the shared range, as specified for a
+  nll += nlpdf_matern_range_prior<Type>({{gp_hyperparam2}}, a_pc_prior, nu,
+					range_a_prior);
+  {{/use_matern}}
+  {{/share_range}}
 
   {{#re_names}}
   // ---------- Likelihood contribution from {{long_name}} ------------------
+  {{^share_range}}
+  PARALLEL_REGION {
+  {{/share_range}}
   // GP latent layer
   vector<Type> mu_{{short_name}} = {{long_name}} -
     design_mat_{{short_name}} * beta_{{short_name}};
+  {{^share_range}}
   nll += nlpdf_gp_{{kernel}}<Type>(mu_{{short_name}}, {{nlpdf_gp_distance}},
 				   exp({{gp_hyperparam1}}_{{short_name}}),
 				   exp({{gp_hyperparam2}}_{{short_name}}),
                                    {{nlpdf_gp_extra}});
+  {{/share_range}}
+  {{#share_range}}
+  nll += gp_shared(mu_{{short_name}}, exp({{gp_hyperparam1}}_{{short_name}}));
+  {{/share_range}}
   // Priors
   nll += nlpdf_beta_prior<Type>(beta_{{short_name}}, beta_prior,
       beta_{{short_name}}_prior(0), beta_{{short_name}}_prior(1));
   {{#use_matern}}
+  {{^share_range}}
   nll += nlpdf_matern_hyperpar_prior<Type>({{gp_hyperparam2}}_{{short_name}},
 					   {{gp_hyperparam1}}_{{short_name}},
 					   {{short_name}}_pc_prior,
                                            nu, range_{{short_name}}_prior,
 					   sigma_{{short_name}}_prior);
+  {{/share_range}}
+  {{#share_range}}
+  nll += nlpdf_matern_sigma_prior<Type>({{gp_hyperparam1}}_{{short_name}},
+					{{short_name}}_pc_prior,
+					sigma_{{short_name}}_prior);
+  {{/share_range}}
   {{/use_matern}}
+  {{^share_range}}
+  } // end PARALLEL_REGION
+  {{/share_range}}
   {{/re_names}}
+  {{#share_range}}
+  } // end PARALLEL_REGION
+  {{/share_range}}
   {{^is_random_s}}
   // FIXME: rename this to not depend on `s`
-  nll += nlpdf_s_prior<Type>({{s_var_loc}}, s_mean, s_sd);
+  PARALLEL_REGION nll += nlpdf_s_prior<Type>({{s_var_loc}}, s_mean, s_sd);
   {{/is_random_s}}
 
   // ------------- Data layer -----------------
-  for(int i=0;i<y.size();i++) {
-    nll -= gev_reparam_lpdf<Type>(y(i), {{a_var_loc}}, {{b_var_loc}},
-	{{s_var_loc}}, reparam_s);
+  // one chunk of groups (or observations) per thread
+  int n_chunk = std::max(obj->max_parallel_regions, 1);
+  int n_unit = obs_offset.size() > 1 ? loc_ind.size() : y.size();
+  for(int k=0; k<n_chunk; k++) {
+    PARALLEL_REGION nll +=
+      gev_data_nll<reparam_s, {{cpp_random_b}}, {{cpp_random_s}}, Type>(
+        y, loc_ind, obs_offset, a, log_b, s,
+        k * n_unit / n_chunk, (k+1) * n_unit / n_chunk);
   }
 
   {{#calc_z_p}}
@@ -194,8 +293,9 @@ Type model_{{random_effects}}_{{kernel}}(objective_function<Type>* obj){
   if(has_returns) {
     matrix<Type> return_levels(return_periods.size(), n_loc);
     for(int i=0; i<n_loc; i++) {
-      gev_reparam_quantile<Type>(return_levels.col(i), return_periods,
-                                 {{a_var}}, {{b_var}}, {{s_var}}, reparam_s);
+      gev_reparam_quantile<reparam_s, Type>(return_levels.col(i),
+                                            return_periods, {{a_var}},
+                                            {{b_var}}, {{s_var}});
     }
     ADREPORT(return_levels);
   }
@@ -203,6 +303,26 @@ Type model_{{random_effects}}_{{kernel}}(objective_function<Type>* obj){
 
   return nll;
 }
+
+/// Dispatches the parametrization of s to the compile-time instantiation of
+/// `model_{{random_effects}}_{{kernel}}{{model_suffix}}_t()`.
+///
+/// @param[in] reparam_s Integer indicating the type of shape parameter, as
+/// described above.
+template<class Type>
+Type model_{{random_effects}}_{{kernel}}{{model_suffix}}(objective_function<Type>* obj){
+  DATA_INTEGER(reparam_s);
+  switch(reparam_s) {
+  case 0:
+    return model_{{random_effects}}_{{kernel}}{{model_suffix}}_t<Type, 0>(obj);
+  case 1:
+    return model_{{random_effects}}_{{kernel}}{{model_suffix}}_t<Type, 1>(obj);
+  case 2:
+    return model_{{random_effects}}_{{kernel}}{{model_suffix}}_t<Type, 2>(obj);
+  default:
+    return model_{{random_effects}}_{{kernel}}{{model_suffix}}_t<Type, 3>(obj);
+  }
+}
 #undef TMB_OBJECTIVE_PTR
 #define TMB_OBJECTIVE_PTR this
 
@@ -5,6 +5,10 @@
 #ifndef SPATIALGEV_UTILS_HPP
 #define SPATIALGEV_UTILS_HPP
 
+#include <vector>
+
+#include "math.hpp"
+
 namespace SpatialGEV {
 
   using namespace R_inla;
@@ -59,6 +63,278 @@ namespace SpatialGEV {
     // return pow(t - Type(1.0)/s) + (s + Type(1.0))/s + log(t);
   }
 
+  /// Log-density of the Gumbel distribution for use with `TMB_BIND_ATOMIC()`.
+  ///
+  /// Same as `gumbel_lpdf()` except that it is templated on the
+  /// `atomic::tiny_ad` scalar type `Float` used to compute the derivatives of
+  /// the atomic function.
+  template <class Float>
+  Float gumbel_lpdf_tiny(const Float x, const Float a, const Float log_b) {
+    Float t = (x - a) / exp(log_b);
+    return -exp(-t) - t - log_b;
+  }
+
+  /// Log-density of the GEV distribution for use with `TMB_BIND_ATOMIC()`.
+  ///
+  /// Same as `gev_lpdf()` except that it is templated on the `atomic::tiny_ad`
+  /// scalar type `Float` used to compute the derivatives of the atomic
+  /// function.  Since the branch on `s` is evaluated each time the atomic is,
+  /// it is not frozen at the value of `s` for which the tape was recorded.
+  template <class Float>
+  Float gev_lpdf_tiny(const Float x, const Float a, const Float log_b,
+		      const Float s) {
+    if ((s <= 1e-7) && (s >= -1e-7)) {
+      return gumbel_lpdf_tiny(x, a, log_b);
+    }
+    Float log_t = log(1.0 + s * (x - a) / exp(log_b));
+    return -exp(-log_t / s) - (s + 1.0) / s * log_t - log_b;
+  }
+
+  // Atomic functions for the Gumbel and GEV log-densities.  The first input
+  // (the observation) is data, hence excluded from the differentiation mask.
+  TMB_BIND_ATOMIC(gumbel_lpdf_atomic, 011,
+		  gumbel_lpdf_tiny(x[0], x[1], x[2]))
+  TMB_BIND_ATOMIC(gev_lpdf_atomic, 0111,
+		  gev_lpdf_tiny(x[0], x[1], x[2], x[3]))
+
+  /// Atomic version of `gumbel_lpdf()`.
+  ///
+  /// Each call is recorded as a single node on the AD tape, with derivatives
+  /// with respect to `a` and `log_b` supplied by the atomic function.
+  ///
+  /// @param[in] x Argument to the density.
+  /// @param[in] a Location parameter.
+  /// @param[in] log_b Log of scale parameter.
+  ///
+  /// @return Log-density of Gumbel distribution evaluated at its inputs.
+  template <class Type>
+  Type gumbel_lpdf_ad(const Type x, const Type a, const Type log_b) {
+    CppAD::vector<Type> tx(4);
+    tx[0] = x;
+    tx[1] = a;
+    tx[2] = log_b;
+    tx[3] = 0; // derivative order
+    return gumbel_lpdf_atomic(tx)[0];
+  }
+
+  /// Atomic version of `gev_lpdf()`.
+  ///
+  /// Each call is recorded as a single node on the AD tape, with derivatives
+  /// with respect to `a`, `log_b` and `s` supplied by the atomic function.
+  ///
+  /// @param[in] x Argument to the density.
+  /// @param[in] a Location parameter.
+  /// @param[in] log_b Log of scale parameter.
+  /// @param[in] s Shape parameter on its natural scale.  Values of `|s| <=
+  /// 1e-7` use the Gumbel log-density.
+  ///
+  /// @return Log-density of GEV distribution evaluated at its inputs.
+  template <class Type>
+  Type gev_lpdf_ad(const Type x, const Type a, const Type log_b,
+		   const Type s) {
+    CppAD::vector<Type> tx(5);
+    tx[0] = x;
+    tx[1] = a;
+    tx[2] = log_b;
+    tx[3] = s;
+    tx[4] = 0; // derivative order
+    return gev_lpdf_atomic(tx)[0];
+  }
+
+  /// Sum of the Gumbel log-densities of a block of observations, for use with
+  /// `gumbel_lpdf_block_atomic()`.
+  ///
+  /// Same as summing `gumbel_lpdf()` over the block, except that the
+  /// observations are data (plain doubles), the inverse scale is computed once
+  /// for the whole block, and the function is templated on the
+  /// `atomic::tiny_ad` scalar type `Float` used to compute the derivatives of
+  /// the atomic function.
+  ///
+  /// @param[in] y Pointer to the first observation of the block.
+  /// @param[in] n_obs Number of observations in the block.
+  /// @param[in] a Location parameter.
+  /// @param[in] log_b Log of scale parameter.
+  template <class Float>
+  Float gumbel_lpdf_block_tiny(const double* y, const int n_obs,
+			       const Float a, const Float log_b) {
+    Float inv_b = exp(-log_b);
+    Float ll = -double(n_obs) * log_b;
+    for (int i = 0; i < n_obs; i++) {
+      Float t = (y[i] - a) * inv_b;
+      ll = ll - (exp(-t) + t);
+    }
+    return ll;
+  }
+
+  /// Sum of the GEV log-densities of a block of observations, for use with
+  /// `gev_lpdf_block_atomic()`.
+  ///
+  /// Same as summing `gev_lpdf()` over the block.  The branch on `s` is taken
+  /// once per block, each time the atomic function is evaluated, so it is not
+  /// frozen at the value of `s` for which the tape was recorded.
+  ///
+  /// @param[in] y Pointer to the first observation of the block.
+  /// @param[in] n_obs Number of observations in the block.
+  /// @param[in] a Location parameter.
+  /// @param[in] log_b Log of scale parameter.
+  /// @param[in] s Shape parameter on its natural scale.
+  template <class Float>
+  Float gev_lpdf_block_tiny(const double* y, const int n_obs, const Float a,
+			    const Float log_b, const Float s) {
+    if ((s <= 1e-7) && (s >= -1e-7)) {
+      return gumbel_lpdf_block_tiny(y, n_obs, a, log_b);
+    }
+    Float s_inv = 1.0 / s;
+    Float s_b = s * exp(-log_b);
+    Float ll = -double(n_obs) * log_b;
+    for (int i = 0; i < n_obs; i++) {
+      Float log_t = log(1.0 + (y[i] - a) * s_b);
+      ll = ll - (exp(-log_t * s_inv) + (1.0 + s_inv) * log_t);
+    }
+    return ll;
+  }
+
+  /// Derivatives of a given order of the block log-density.
+  ///
+  /// @tparam order Derivative order, between 1 and 3.
+  /// @tparam n_par Number of parameters: 2 for `(a, log_b)` (Gumbel), 3 for
+  /// `(a, log_b, s)` (GEV).
+  /// @param[in] tx Input of the atomic function: the `n_par` parameters,
+  /// followed by the observations and the derivative order.
+  /// @param[out] ty Output of the atomic function: the `n_par^order`
+  /// derivatives with respect to the parameters.
+  template <int order, int n_par>
+  void gev_lpdf_block_deriv(const CppAD::vector<double>& tx,
+			    CppAD::vector<double>& ty) {
+    typedef atomic::tiny_ad::variable<order, n_par> Float;
+    int n_obs = tx.size() - n_par - 1;
+    Float a(tx[0], 0);
+    Float log_b(tx[1], 1);
+    Float ll;
+    if (n_par == 2) {
+      ll = gumbel_lpdf_block_tiny(&tx[n_par], n_obs, a, log_b);
+    } else {
+      Float s(tx[2], n_par - 1);
+      ll = gev_lpdf_block_tiny(&tx[n_par], n_obs, a, log_b, s);
+    }
+    auto deriv = ll.getDeriv();
+    for (size_t k = 0; k < ty.size(); k++) ty[k] = deriv[k];
+  }
+
+  /// Forward evaluation of the block atomic functions.
+  ///
+  /// @tparam n_par Number of parameters: 2 (Gumbel) or 3 (GEV).
+  /// @param[in] tx Input of the atomic function, as in
+  /// `gev_lpdf_block_deriv()`.
+  /// @param[out] ty Block log-density (order 0) or its derivatives.
+  template <int n_par>
+  void gev_lpdf_block_eval(const CppAD::vector<double>& tx,
+			   CppAD::vector<double>& ty) {
+    int order = CppAD::Integer(tx[tx.size() - 1]);
+    int n_obs = tx.size() - n_par - 1;
+    switch (order) {
+    case 0:
+      ty[0] = (n_par == 2) ?
+	gumbel_lpdf_block_tiny<double>(&tx[n_par], n_obs, tx[0], tx[1]) :
+	gev_lpdf_block_tiny<double>(&tx[n_par], n_obs, tx[0], tx[1], tx[2]);
+      break;
+    case 1:
+      gev_lpdf_block_deriv<1, n_par>(tx, ty);
+      break;
+    case 2:
+      gev_lpdf_block_deriv<2, n_par>(tx, ty);
+      break;
+    case 3:
+      gev_lpdf_block_deriv<3, n_par>(tx, ty);
+      break;
+    default:
+      Rf_error("Order not implemented.");
+    }
+  }
+
+  /// Reverse mode of the block atomic functions.
+  ///
+  /// Contracts the derivatives of the next order, `ty_next`, with the range
+  /// direction `py`.  The observations and the derivative order are data, so
+  /// their entries of `px` are zero.
+  ///
+  /// @tparam n_par Number of parameters: 2 (Gumbel) or 3 (GEV).
+  /// @param[in] ty_next Output of the atomic function at the next order.
+  /// @param[in] py Range direction.
+  /// @param[out] px Domain direction.
+  template <int n_par, class Type>
+  void gev_lpdf_block_contract(const CppAD::vector<Type>& ty_next,
+			       const CppAD::vector<Type>& py,
+			       CppAD::vector<Type>& px) {
+    for (size_t j = 0; j < px.size(); j++) px[j] = Type(0.0);
+    for (int j = 0; j < n_par; j++) {
+      for (size_t k = 0; k < py.size(); k++) {
+	px[j] += ty_next[k * n_par + j] * py[k];
+      }
+    }
+  }
+
+  // Atomic functions for the sum of the Gumbel and GEV log-densities over a
+  // block of observations sharing the same parameters.  The input is
+  // `(a, log_b[, s], y_1, ..., y_n, order)`, and the output has length
+  // `n_par^order`.  Unlike `TMB_BIND_ATOMIC()`, the input length varies with
+  // the number of observations, so the derivatives are coded by hand: each
+  // order is computed with `atomic::tiny_ad`, and the reverse mode calls the
+  // atomic function at the next order.
+  TMB_ATOMIC_VECTOR_FUNCTION(
+    gumbel_lpdf_block_atomic,
+    (size_t) pow(2.0, CppAD::Integer(tx[tx.size() - 1])),
+    gev_lpdf_block_eval<2>(tx, ty);
+    ,
+    CppAD::vector<Type> tx_(tx);
+    tx_[tx.size() - 1] += Type(1.0);
+    gev_lpdf_block_contract<2>(gumbel_lpdf_block_atomic(tx_), py, px);
+    )
+  TMB_ATOMIC_VECTOR_FUNCTION(
+    gev_lpdf_block_atomic,
+    (size_t) pow(3.0, CppAD::Integer(tx[tx.size() - 1])),
+    gev_lpdf_block_eval<3>(tx, ty);
+    ,
+    CppAD::vector<Type> tx_(tx);
+    tx_[tx.size() - 1] += Type(1.0);
+    gev_lpdf_block_contract<3>(gev_lpdf_block_atomic(tx_), py, px);
+    )
+
+  /// Atomic version of the sum of `gumbel_lpdf()` or `gev_lpdf()` over a block
+  /// of observations.
+  ///
+  /// The whole block is recorded as a single node on the AD tape, with
+  /// derivatives with respect to `a`, `log_b` and `s` supplied by the atomic
+  /// function.
+  ///
+  /// @tparam gumbel Whether to use the Gumbel log-density, in which case `s`
+  /// is ignored.
+  /// @param[in] y Vector of observations.
+  /// @param[in] a Location parameter.
+  /// @param[in] log_b Log of scale parameter.
+  /// @param[in] s Shape parameter on its natural scale.  Values of `|s| <=
+  /// 1e-7` use the Gumbel log-density.
+  ///
+  /// @return Sum of the log-densities of the elements of `y`.
+  template <bool gumbel, class Type>
+  Type gev_lpdf_block_ad(cRefVector_t<Type> y, const Type a,
+			 const Type log_b, const Type s) {
+    int n_obs = y.size();
+    if (n_obs == 0) return Type(0.0);
+    int n_par = gumbel ? 2 : 3;
+    CppAD::vector<Type> tx(n_par + n_obs + 1);
+    tx[0] = a;
+    tx[1] = log_b;
+    if (!gumbel) tx[2] = s;
+    for (int i = 0; i < n_obs; i++) tx[n_par + i] = y(i);
+    tx[n_par + n_obs] = 0; // derivative order
+    if (gumbel) {
+      return gumbel_lpdf_block_atomic(tx)[0];
+    } else {
+      return gev_lpdf_block_atomic(tx)[0];
+    }
+  }
+
   /// Compute the exponential kernel function
   ///
   /// @param[in] x Value to evaluate at
@@ -101,6 +377,52 @@ namespace SpatialGEV {
     return;
   }
 
+  /// Order of the closed-form Matern correlation for half-integer smoothness.
+  ///
+  /// `Type` version of `matern_half_order()` in `math.hpp`, for the
+  /// smoothness parameter read with `DATA_SCALAR()`.
+  template <class Type>
+  int matern_half_order(const Type nu) {
+    return matern_half_order(asDouble(nu));
+  }
+
+  /// Matern correlation function with compile-time smoothness.
+  ///
+  /// For `nu = NU2/2` with `NU2` one of 1, 3, or 5, the Matern correlation at
+  /// scaled distance `r = kappa * d` is `exp(-r)` times a polynomial in `r`,
+  /// which avoids the Bessel function evaluation of `matern()`.  For `NU2 = 0`,
+  /// `matern()` is used with the smoothness `nu`.
+  ///
+  /// @tparam NU2 Twice the smoothness parameter, or 0 for general `nu`.
+  /// @param[in] d Distance.
+  /// @param[in] kappa Inverse range (lengthscale) hyperparameter of the Matern. Positive.
+  /// @param[in] nu Smoothness parameter of the Matern.  Only used if `NU2 = 0`.
+  template <int NU2, class Type>
+  Type matern_cor(const Type d, const Type kappa, const Type nu) {
+    Type r = kappa * d;
+    if (NU2 == 1) return exp(-r);
+    if (NU2 == 3) return (Type(1.0) + r) * exp(-r);
+    if (NU2 == 5) return (Type(1.0) + r + r * r / Type(3.0)) * exp(-r);
+    return matern(d, 1/kappa, nu);
+  }
+
+  /// Compute the Matern correlations at a matrix of distances for half-integer
+  /// smoothness.
+  ///
+  /// The correlations are computed in a single sweep over `dist_mat`.
+  ///
+  /// @tparam NU2 Twice the smoothness parameter: one of 1, 3, or 5.
+  /// @param[out] cov Matrix into which to store the output.
+  /// @param[in] dist_mat Distance matrix.  Can also be a column vector of
+  /// distances.
+  /// @param[in] kappa Inverse range (lengthscale) hyperparameter of the Matern. Positive.
+  template <int NU2, class Type>
+  void cov_matern_half(RefMatrix_t<Type> cov, cRefMatrix_t<Type>& dist_mat,
+		       const Type kappa) {
+    cov = matern_half_array<NU2>(kappa * dist_mat.array()).matrix();
+    return;
+  }
+
   /// Compute the variance matrix for the matern kernel.
   ///
   /// @param[out] cov Matrix into which to store the output.
@@ -139,48 +461,388 @@ namespace SpatialGEV {
     return;
   }
 
-  /// Negative log likelihood of the exponential Gaussian process prior.
+  /// Compute a sparse variance matrix from a list of neighbouring locations.
+  ///
+  /// @param[in] n Number of locations.
+  /// @param[in] sp_nb Integer matrix of size `n_pair x 2` of (0-based) indices
+  /// of the pairs of locations with nonzero covariance.
+  /// @param[in] cov_nb Vector of length `n_pair` of correlations between the
+  /// pairs of locations in `sp_nb`.
+  ///
+  /// @return Symmetric sparse matrix with unit diagonal.
+  template <class Type>
+  Eigen::SparseMatrix<Type> cov_sparse(const int n, cRefMatrix_t<int>& sp_nb,
+				       cRefVector_t<Type>& cov_nb) {
+    int n_pair = sp_nb.rows();
+    std::vector<Eigen::Triplet<Type> > trip;
+    trip.reserve(n + 2*n_pair);
+    for (int i = 0; i < n; i++) {
+      trip.push_back(Eigen::Triplet<Type>(i, i, Type(1)));
+    }
+    for (int k = 0; k < n_pair; k++) {
+      trip.push_back(Eigen::Triplet<Type>(sp_nb(k,0), sp_nb(k,1), cov_nb(k)));
+      trip.push_back(Eigen::Triplet<Type>(sp_nb(k,1), sp_nb(k,0), cov_nb(k)));
+    }
+    Eigen::SparseMatrix<Type> cov(n, n);
+    cov.setFromTriplets(trip.begin(), trip.end());
+    return cov;
+  }
+
+  /// Multiply correlations by the Wendland taper with support `sp_thres`.
+  ///
+  /// The taper is `(1 - r)^4 (1 + 4 r)` with `r = d / sp_thres`, which is a
+  /// positive definite correlation function in up to three dimensions that
+  /// vanishes for `d >= sp_thres`.  By the Schur product theorem, the tapered
+  /// correlation matrix is therefore positive definite, whereas setting the
+  /// correlations beyond `sp_thres` to zero need not be.
+  ///
+  /// @param[in,out] cov_nb Vector of correlations to taper.
+  /// @param[in] sp_dist Vector of corresponding distances, all less than
+  /// `sp_thres`.
+  /// @param[in] sp_thres Support of the taper.
+  template <class Type>
+  void cov_taper_wendland(RefVector_t<Type> cov_nb, cRefVector_t<Type>& sp_dist,
+			  const Type sp_thres) {
+    for (int k = 0; k < cov_nb.size(); k++) {
+      Type r = sp_dist(k) / sp_thres;
+      Type r1 = Type(1.0) - r;
+      cov_nb(k) *= r1 * r1 * r1 * r1 * (Type(1.0) + Type(4.0) * r);
+    }
+    return;
+  }
+
+  /// Error message for a sparse correlation matrix which is not positive
+  /// definite.
+  static const char* const gp_not_pd_msg = "Sparse correlation matrix is not positive definite.  Use a tapered covariance (sp_taper = TRUE) or a larger sp_thres.";
+
+  // Atomic function for the log-determinant of an `LDL^T` factorization,
+  // i.e., the sum of the logs of its pivots.  The pivots are checked to be
+  // positive in the forward mode, so that the check is made each time the
+  // tape is evaluated at new hyperparameters, and not only when the tape is
+  // recorded.
+  TMB_ATOMIC_VECTOR_FUNCTION(
+    logdet_pivots_atomic,
+    1,
+    ty[0] = 0.0;
+    for (size_t i = 0; i < tx.size(); i++) {
+      if (!(tx[i] > 0.0)) Rf_error("%s", gp_not_pd_msg);
+      ty[0] += log(tx[i]);
+    }
+    ,
+    for (size_t i = 0; i < tx.size(); i++) px[i] = py[0] / tx[i];
+    )
+
+  /// Density of zero-mean Gaussian processes with a common correlation matrix.
+  ///
+  /// The correlation matrix is factorized once by `compute()` or
+  /// `compute_sparse()`, after which the density can be evaluated for any
+  /// number of latent fields sharing this correlation matrix, possibly with
+  /// different scale parameters.  The sparse version uses an `LDL^T`
+  /// decomposition with fill-reducing ordering, so that the cost scales with
+  /// the number of nonzeros of the factor rather than with `n^3`.  Both have
+  /// the same normalizing constant as `density::MVNORM()`.
+  template <class Type>
+  class gp_mvnorm_t {
+  public:
+    /// Factorize a dense correlation matrix.
+    void compute(const matrix<Type>& cov) {
+      is_sparse_ = false;
+      dense_ = MVNORM_t<Type>(cov);
+    }
+
+    /// Factorize a sparse correlation matrix.
+    void compute_sparse(const Eigen::SparseMatrix<Type>& cov) {
+      is_sparse_ = true;
+      sparse_.compute(cov);
+      if (sparse_.info() != Eigen::Success) {
+	Rf_error("%s", gp_not_pd_msg);
+      }
+      int n = cov.rows();
+      CppAD::vector<Type> tx(n);
+      for (int i = 0; i < n; i++) tx[i] = sparse_.vectorD()(i);
+      logdet_ = logdet_pivots_atomic(tx)[0];
+    }
+
+    /// Negative log-density of the GP with scale parameter `sigma`.
+    ///
+    /// @param[in] mu Argument to the density.
+    /// @param[in] sigma Scale parameter.
+    Type operator()(cRefVector_t<Type> mu, const Type sigma) {
+      int n = mu.size();
+      vector<Type> x = mu / sigma;
+      Type nll;
+      if (is_sparse_) {
+	Eigen::Matrix<Type, Eigen::Dynamic, 1> z = sparse_.solve(x.matrix());
+	nll = Type(0.5) * logdet_ + Type(0.5) * x.matrix().dot(z) +
+	  Type(n) * Type(log(sqrt(2.0 * M_PI)));
+      } else {
+	nll = dense_(x);
+      }
+      return nll + Type(n) * log(sigma);
+    }
+
+  private:
+    bool is_sparse_;
+    MVNORM_t<Type> dense_;
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<Type> > sparse_;
+    Type logdet_;
+  };
+
+  /// Factorize the correlation matrix of the exponential kernel.
+  ///
+  /// If `sp_thres = -1`, the dense correlation matrix is computed from
+  /// `dist_mat`.  Otherwise, the correlation matrix is assembled directly in
+  /// sparse form from the pairs of locations in `sp_nb`, and `dist_mat` is not
+  /// used.  The sparse correlations are either multiplied by the Wendland
+  /// taper of `cov_taper_wendland()`, or set to zero beyond `sp_thres`
+  /// (`sp_taper = 0`), in which case the correlation matrix is that of the
+  /// dense mode with hard thresholding, but need not be positive definite.
+  ///
+  /// @param[out] gp GP density object in which to store the factorization.
+  /// @param[in] n Number of locations.
+  /// @param[in] dist_mat Distance matrix.
+  /// @param[in] sp_nb Integer matrix of size `n_pair x 2` of (0-based) indices
+  /// of the pairs of locations at distance less than `sp_thres`.
+  /// @param[in] sp_dist Vector of length `n_pair` of distances between the
+  /// pairs of locations in `sp_nb`.
+  /// @param[in] ell Range (lengthscale) parameter.
+  /// @param[in] sp_thres Threshold parameter.
+  /// @param[in] sp_taper Whether to taper the sparse correlations.
+  template <class Type>
+  void gp_factor_exp(gp_mvnorm_t<Type>& gp, const int n,
+		     cRefMatrix_t<Type>& dist_mat,
+		     cRefMatrix_t<int>& sp_nb, cRefVector_t<Type>& sp_dist,
+		     const Type ell, const Type sp_thres, const int sp_taper) {
+    if (sp_thres == -1) {
+      matrix<Type> cov(n,n);
+      cov_expo<Type>(cov, dist_mat, ell, sp_thres);
+      gp.compute(cov);
+    } else {
+      Eigen::Matrix<Type, Eigen::Dynamic, 1> cov_nb =
+	(-sp_dist.array() / ell).exp().matrix();
+      if (sp_taper) cov_taper_wendland<Type>(cov_nb, sp_dist, sp_thres);
+      gp.compute_sparse(cov_sparse<Type>(n, sp_nb, cov_nb));
+    }
+    return;
+  }
+
+  /// Factorize the correlation matrix of the Matern kernel with compile-time
+  /// smoothness.
+  ///
+  /// See `gp_factor_matern()` for the arguments.
+  ///
+  /// @tparam NU2 Twice the smoothness parameter, or 0 for general `nu`.  See
+  /// `matern_cor()`.
+  template <int NU2, class Type>
+  void gp_factor_matern_nu(gp_mvnorm_t<Type>& gp, const int n,
+			   cRefMatrix_t<Type>& dist_mat,
+			   cRefMatrix_t<int>& sp_nb, cRefVector_t<Type>& sp_dist,
+			   const Type kappa, const Type nu, const Type sp_thres,
+			   const int sp_taper) {
+    if (sp_thres == -1) {
+      matrix<Type> cov(n,n);
+      if (NU2 > 0) {
+	cov_matern_half<NU2, Type>(cov, dist_mat, kappa);
+      } else {
+	cov_matern<Type>(cov, dist_mat, kappa, nu, sp_thres);
+      }
+      gp.compute(cov);
+    } else {
+      int n_pair = sp_dist.size();
+      Eigen::Matrix<Type, Eigen::Dynamic, 1> cov_nb(n_pair);
+      if (NU2 > 0) {
+	cov_matern_half<NU2, Type>(cov_nb, sp_dist, kappa);
+      } else {
+	for (int k = 0; k < n_pair; k++) {
+	  cov_nb(k) = matern(sp_dist(k), 1/kappa, nu);
+	}
+      }
+      if (sp_taper) cov_taper_wendland<Type>(cov_nb, sp_dist, sp_thres);
+      gp.compute_sparse(cov_sparse<Type>(n, sp_nb, cov_nb));
+    }
+    return;
+  }
+
+  /// Factorize the correlation matrix of the Matern kernel.
+  ///
+  /// See `gp_factor_exp()` for details.  For `nu` one of 0.5, 1.5, or 2.5, the
+  /// correlations are computed in closed form by `cov_matern_half()`.  The
+  /// value of `nu` is dispatched once to `gp_factor_matern_nu()`.
+  ///
+  /// @param[out] gp GP density object in which to store the factorization.
+  /// @param[in] n Number of locations.
+  /// @param[in] dist_mat Distance matrix.
+  /// @param[in] sp_nb Integer matrix of size `n_pair x 2` of (0-based) indices
+  /// of the pairs of locations at distance less than `sp_thres`.
+  /// @param[in] sp_dist Vector of length `n_pair` of distances between the
+  /// pairs of locations in `sp_nb`.
+  /// @param[in] kappa Inverse range (lengthscale) hyperparameter of the Matern. Positive.
+  /// @param[in] nu Smoothness parameter of the Matern.
+  /// @param[in] sp_thres Threshold parameter.
+  /// @param[in] sp_taper Whether to taper the sparse correlations.
+  template <class Type>
+  void gp_factor_matern(gp_mvnorm_t<Type>& gp, const int n,
+			cRefMatrix_t<Type>& dist_mat,
+			cRefMatrix_t<int>& sp_nb, cRefVector_t<Type>& sp_dist,
+			const Type kappa, const Type nu, const Type sp_thres,
+			const int sp_taper) {
+    switch (matern_half_order(nu)) {
+    case 1:
+      gp_factor_matern_nu<1, Type>(gp, n, dist_mat, sp_nb, sp_dist, kappa, nu,
+				   sp_thres, sp_taper);
+      break;
+    case 3:
+      gp_factor_matern_nu<3, Type>(gp, n, dist_mat, sp_nb, sp_dist, kappa, nu,
+				   sp_thres, sp_taper);
+      break;
+    case 5:
+      gp_factor_matern_nu<5, Type>(gp, n, dist_mat, sp_nb, sp_dist, kappa, nu,
+				   sp_thres, sp_taper);
+      break;
+    default:
+      gp_factor_matern_nu<0, Type>(gp, n, dist_mat, sp_nb, sp_dist, kappa, nu,
+				   sp_thres, sp_taper);
+    }
+    return;
+  }
+
+  /// Negative log likelihood of the exponential Gaussian process prior with
+  /// optional sparse computation.
+  ///
+  /// See `gp_factor_exp()` for details.
   ///
-  /// @param[out] nll negative log-likelihood accumulator.
   /// @param[in] mu Mean vector of the GP
   /// @param[in] dist_mat Distance matrix.
+  /// @param[in] sp_nb Integer matrix of size `n_pair x 2` of (0-based) indices
+  /// of the pairs of locations at distance less than `sp_thres`.
+  /// @param[in] sp_dist Vector of length `n_pair` of distances between the
+  /// pairs of locations in `sp_nb`.
   /// @param[in] sigma Scale parameter for the exponential covariance.
   /// @param[in] ell Range (lengthscale) parameter for the exponential covariance.
   /// @param[in] sp_thres Threshold parameter.
+  /// @param[in] sp_taper Whether to taper the sparse correlations.
   template <class Type>
   Type nlpdf_gp_exp(cRefVector_t<Type> mu, cRefMatrix_t<Type>& dist_mat,
-		  const Type sigma, const Type ell, const Type sp_thres) {
-    int n = dist_mat.rows();
-    matrix<Type> cov(n,n);
-    cov_expo<Type>(cov, dist_mat, ell, sp_thres); // construct the covariance matrix
-    Type nll = SCALE(MVNORM(cov), sigma)(mu);
-    return nll;
+		    cRefMatrix_t<int>& sp_nb, cRefVector_t<Type>& sp_dist,
+		    const Type sigma, const Type ell, const Type sp_thres,
+		    const int sp_taper) {
+    gp_mvnorm_t<Type> gp;
+    gp_factor_exp<Type>(gp, mu.size(), dist_mat, sp_nb, sp_dist, ell, sp_thres,
+			sp_taper);
+    return gp(mu, sigma);
   }
 
-  /// Negative log likelihood of the Matern Gaussian process prior.
+  /// Negative log likelihood of the Matern Gaussian process prior with optional
+  /// sparse computation.
+  ///
+  /// See `gp_factor_matern()` for details.
   ///
-  /// @param[out] nll negative log-likelihood accumulator.
   /// @param[in] mu Mean vector of the GP
   /// @param[in] dist_mat Distance matrix.
+  /// @param[in] sp_nb Integer matrix of size `n_pair x 2` of (0-based) indices
+  /// of the pairs of locations at distance less than `sp_thres`.
+  /// @param[in] sp_dist Vector of length `n_pair` of distances between the
+  /// pairs of locations in `sp_nb`.
   /// @param[in] sigma Scale hyperparameter of the Matern.
   /// @param[in] kappa Inverse range (lengthscale) hyperparameter of the Matern. Positive.
   /// @param[in] nu Smoothness parameter of the Matern.
   /// @param[in] sp_thres Threshold parameter.
+  /// @param[in] sp_taper Whether to taper the sparse correlations.
   template <class Type>
   Type nlpdf_gp_matern(cRefVector_t<Type> mu, cRefMatrix_t<Type>& dist_mat,
-		  const Type sigma, const Type kappa, const Type nu, const Type sp_thres) {
-    int n = dist_mat.rows();
-    matrix<Type> cov(n,n);
-    cov_matern<Type>(cov, dist_mat, kappa, nu, sp_thres); // construct the covariance matrix
-    Type nll = SCALE(MVNORM(cov), sigma)(mu);
-    return nll;
+		       cRefMatrix_t<int>& sp_nb, cRefVector_t<Type>& sp_dist,
+		       const Type sigma, const Type kappa, const Type nu,
+		       const Type sp_thres, const int sp_taper) {
+    gp_mvnorm_t<Type> gp;
+    gp_factor_matern<Type>(gp, mu.size(), dist_mat, sp_nb, sp_dist, kappa, nu,
+			   sp_thres, sp_taper);
+    return gp(mu, sigma);
+  }
+
+  /// Negative log likelihood of the nearest-neighbour (Vecchia) approximation
+  /// to the Matern Gaussian process prior.
+  ///
+  /// The joint density of `mu` is approximated by the product over locations
+  /// `i` of the conditional densities of `mu(i)` given its (at most `m`)
+  /// nearest neighbours among the locations `0, ..., i-1`.  Each conditional
+  /// requires the inverse of an `m x m` Matern correlation matrix, so the cost
+  /// is linear in the number of locations.
+  ///
+  /// @param[in] mu Mean vector of the GP.
+  /// @param[in] nn_ind Integer matrix of size `n_loc x m` of (0-based)
+  /// neighbour indices, such that `nn_ind(i,j) < i`.  Locations with fewer
+  /// than `m` neighbours are padded with -1 at the end of the row.
+  /// @param[in] nn_dist Array of size `(m+1) x (m+1) x n_loc` such that
+  /// `nn_dist(.,.,i)` is the distance matrix between location `i` (first
+  /// index) and its neighbours.
+  /// @param[in] sigma Scale hyperparameter of the Matern.
+  /// @param[in] kappa Inverse range (lengthscale) hyperparameter of the Matern. Positive.
+  /// @param[in] nu Smoothness parameter of the Matern.
+  ///
+  /// @tparam NU2 Twice the smoothness parameter, or 0 for general `nu`.  See
+  /// `matern_cor()`.
+  template <int NU2, class Type>
+  Type nlpdf_gp_nngp_nu(cRefVector_t<Type> mu, cRefMatrix_t<int>& nn_ind,
+			const array<Type>& nn_dist,
+			const Type sigma, const Type kappa, const Type nu) {
+    int n = mu.size();
+    int m = nn_ind.cols();
+    vector<Type> x = mu / sigma;
+    Type nll = Type(0.0);
+    for (int i = 0; i < n; i++) {
+      int k = 0; // number of neighbours of location i
+      while (k < m && nn_ind(i,k) >= 0) k++;
+      Type cond_mean = Type(0.0);
+      Type cond_var = Type(1.0);
+      if (k > 0) {
+	matrix<Type> cov_nn(k,k);
+	vector<Type> cov_in(k);
+	vector<Type> x_nn(k);
+	for (int j = 0; j < k; j++) {
+	  cov_in(j) = matern_cor<NU2>(nn_dist(0,j+1,i), kappa, nu);
+	  x_nn(j) = x(nn_ind(i,j));
+	  cov_nn(j,j) = Type(1);
+	  for (int l = 0; l < j; l++) {
+	    cov_nn(j,l) = matern_cor<NU2>(nn_dist(j+1,l+1,i), kappa, nu);
+	    cov_nn(l,j) = cov_nn(j,l);
+	  }
+	}
+	// kriging weights of the neighbours
+	matrix<Type> cov_nn_inv = atomic::matinv(cov_nn);
+	vector<Type> wt = cov_nn_inv * cov_in;
+	cond_mean = (wt * x_nn).sum();
+	cond_var -= (wt * cov_in).sum();
+      }
+      nll -= dnorm(x(i), cond_mean, sqrt(cond_var), true);
+    }
+    return nll + Type(n) * log(sigma);
+  }
+
+  /// Negative log likelihood of the nearest-neighbour (Vecchia) approximation
+  /// to the Matern Gaussian process prior.
+  ///
+  /// Dispatches `nu` to the closed-form correlation of `nlpdf_gp_nngp_nu()`
+  /// when it is one of 0.5, 1.5, or 2.5.
+  template <class Type>
+  Type nlpdf_gp_nngp(cRefVector_t<Type> mu, cRefMatrix_t<int>& nn_ind,
+		     const array<Type>& nn_dist,
+		     const Type sigma, const Type kappa, const Type nu) {
+    switch (matern_half_order(nu)) {
+    case 1:
+      return nlpdf_gp_nngp_nu<1, Type>(mu, nn_ind, nn_dist, sigma, kappa, nu);
+    case 3:
+      return nlpdf_gp_nngp_nu<3, Type>(mu, nn_ind, nn_dist, sigma, kappa, nu);
+    case 5:
+      return nlpdf_gp_nngp_nu<5, Type>(mu, nn_ind, nn_dist, sigma, kappa, nu);
+    default:
+      return nlpdf_gp_nngp_nu<0, Type>(mu, nn_ind, nn_dist, sigma, kappa, nu);
+    }
   }
 
   /// Negative log likelihood of the Matern-SPDE Gaussian process prior.
   ///
-  /// @param[out] nll negative log-likelihood accumulator.
-  /// @param[in] spde the returned object by INLA::inla.spde2.matern in R.
   /// @param[in] mu Mean vector of the GP.
+  /// @param[in] spde the returned object by INLA::inla.spde2.matern in R.
   /// @param[in] sigma Scale hyperparameter of the Matern.
   /// @param[in] kappa Inverse range (lengthscale) hyperparameter of the Matern. Positive.
   /// @param[in] nu Smoothness parameter of the Matern.
@@ -215,44 +877,89 @@ namespace SpatialGEV {
     return nll;
   }
 
-  /// Add negative log-likelihood contributed by prior on Matern hyperparameters
+  /// Add negative log-likelihood contributed by the PC prior on the Matern range
+  ///
+  /// This is the range part of `nlpdf_matern_hyperpar_prior()`, for use when
+  /// the range parameter is shared by several GPs.
   ///
   /// @param[out] nll Negative log-likelihood accumulator.
   /// @param[in] log_kappa Log of inverse range parameter of Matern
-  /// @param[in] log_sigma Log of marginal scale parameter of Matern
   /// @param[in] prior Type of prior. 1 is weakly penalized complexity (PC) prior and any other
   /// number means noninformative prior.
   /// @param[in] nu Matern smoothness hyperparameter.
   /// @param[in] range_prior. Length 2 vector (rho_0, p_rho) s.t. P(rho < rho_0) = p_rho.
   /// Only relevant if prior=1.
-  /// @param[in] sigma_prior. Length 2 vector (sig_0, p_sig) s.t. P(sig > sig_0) = p_sig.
-  /// Only relevant if prior=1.
   template <class Type>
-  Type nlpdf_matern_hyperpar_prior(const Type log_kappa, const Type log_sigma,
-                                       const int prior, const Type nu,
-                                       cRefVector_t<Type> range_prior,
-				       cRefVector_t<Type> sigma_prior) {
+  Type nlpdf_matern_range_prior(const Type log_kappa, const int prior,
+				const Type nu, cRefVector_t<Type> range_prior) {
     Type nll = Type(0.0);
     if (prior == 1) {
-       // See Theorem 6 of Fuglstad et al. (2017) https://arxiv.org/pdf/1503.00256.pdf
        Type log_rho = 0.5*log(8.0*nu) - log_kappa; // get range parameter
        Type rho = exp(log_rho);
-       Type sig = exp(log_sigma);
        Type rho_0 = range_prior[0];
        Type p_rho = range_prior[1];
+       Type lam1 = -1.0 * log(p_rho) * rho_0;
+       Type logpi = log(lam1) - 2.0 * log_rho - lam1 / rho;
+       // Jacobian adjustment = log(1 / |dlogkappa/drho|)
+       logpi += 0.5*log(8.0*nu) - log_kappa;
+       nll -= logpi;
+    }
+    return nll;
+  }
+
+  /// Add negative log-likelihood contributed by the PC prior on the Matern scale
+  ///
+  /// This is the scale part of `nlpdf_matern_hyperpar_prior()`, for use when
+  /// the range parameter is shared by several GPs.
+  ///
+  /// @param[out] nll Negative log-likelihood accumulator.
+  /// @param[in] log_sigma Log of marginal scale parameter of Matern
+  /// @param[in] prior Type of prior. 1 is weakly penalized complexity (PC) prior and any other
+  /// number means noninformative prior.
+  /// @param[in] sigma_prior. Length 2 vector (sig_0, p_sig) s.t. P(sig > sig_0) = p_sig.
+  /// Only relevant if prior=1.
+  template <class Type>
+  Type nlpdf_matern_sigma_prior(const Type log_sigma, const int prior,
+				cRefVector_t<Type> sigma_prior) {
+    Type nll = Type(0.0);
+    if (prior == 1) {
+       Type sig = exp(log_sigma);
        Type sig_0 = sigma_prior[0];
        Type p_sig = sigma_prior[1];
-       Type lam1 = -1.0 * log(p_rho) * rho_0;
        Type lam2 = -1.0 * log(p_sig) / sig_0;
-       // PC prior log density
-       Type logpi = log(lam1) + log(lam2) - 2.0 * log_rho - lam1 / rho - lam2 * sig;
-       // Jacobian adjustment = log(1 / (|dlogkappa/drho| * |dlogsigma/dsig|))
-       logpi += log_sigma + 0.5*log(8.0*nu) - log_kappa;
+       Type logpi = log(lam2) - lam2 * sig;
+       // Jacobian adjustment = log(1 / |dlogsigma/dsig|)
+       logpi += log_sigma;
        nll -= logpi;
     }
     return nll;
   }
 
+  /// Add negative log-likelihood contributed by prior on Matern hyperparameters
+  ///
+  /// See Theorem 6 of Fuglstad et al. (2017) https://arxiv.org/pdf/1503.00256.pdf.  The PC prior
+  /// is the product of the priors computed by `nlpdf_matern_range_prior()` and
+  /// `nlpdf_matern_sigma_prior()`.
+  ///
+  /// @param[out] nll Negative log-likelihood accumulator.
+  /// @param[in] log_kappa Log of inverse range parameter of Matern
+  /// @param[in] log_sigma Log of marginal scale parameter of Matern
+  /// @param[in] prior Type of prior. 1 is weakly penalized complexity (PC) prior and any other
+  /// number means noninformative prior.
+  /// @param[in] nu Matern smoothness hyperparameter.
+  /// @param[in] range_prior. Length 2 vector (rho_0, p_rho) s.t. P(rho < rho_0) = p_rho.
+  /// Only relevant if prior=1.
+  /// @param[in] sigma_prior. Length 2 vector (sig_0, p_sig) s.t. P(sig > sig_0) = p_sig.
+  /// Only relevant if prior=1.
+  template <class Type>
+  Type nlpdf_matern_hyperpar_prior(const Type log_kappa, const Type log_sigma,
+                                       const int prior, const Type nu,
+                                       cRefVector_t<Type> range_prior,
+				       cRefVector_t<Type> sigma_prior) {
+    return nlpdf_matern_range_prior<Type>(log_kappa, prior, nu, range_prior) +
+      nlpdf_matern_sigma_prior<Type>(log_sigma, prior, sigma_prior);
+  }
+
   /// Add negative log-likelihood contributed by prior on scalar s. Not needed if s is random
   ///
   /// @param[out] nll Negative log-likelihood.
@@ -270,6 +977,9 @@ namespace SpatialGEV {
 
   /// Log-likelihood of the GEV distribution based on different parameterization of s.
   ///
+  /// For AD types, the observation is recorded as a single atomic node via
+  /// `gev_lpdf_ad()` or `gumbel_lpdf_ad()`.
+  ///
   /// @param[out] ll log-likelihood.
   /// @param[in] y Data.
   /// @param[in] a GEV Location parameter.
@@ -280,22 +990,202 @@ namespace SpatialGEV {
   Type gev_reparam_lpdf(const Type y, const Type a, const Type log_b, Type s,
 		        const int reparam_s) {
     Type ll;
+    bool use_atomic = !isDouble<Type>::value;
     if (reparam_s == 0){ // this is the case we are using Gumbel distribution
-      ll = gumbel_lpdf<Type>(y, a, log_b);
+      ll = use_atomic ? gumbel_lpdf_ad<Type>(y, a, log_b) :
+	gumbel_lpdf<Type>(y, a, log_b);
     } else{ // the case where we are using GEV distribution with nonzero shape parameter
-      if (reparam_s == 1){ // if we have stated that s is constrained to be positive, this implies that we are optimizing log(s)
-	s = exp(s);
-      } else if (reparam_s == 2){ // if we have stated that s is constrained to be negative, this implies that we are optimizing log(-s)
-	s = -exp(s);
-      } // if we don't use any reparametrization, then s is unconstrained
-      ll = gev_lpdf<Type>(y, a, log_b, s);
+      s = gev_reparam_shape<Type>(s, reparam_s);
+      ll = use_atomic ? gev_lpdf_ad<Type>(y, a, log_b, s) :
+	gev_lpdf<Type>(y, a, log_b, s);
     } // end else
     return ll;
   }
 
+  /// Log-likelihood of the GEV distribution with compile-time
+  /// reparametrization of s.
+  ///
+  /// For AD types, the observation is recorded as a single atomic node via
+  /// `gev_lpdf_ad()` or `gumbel_lpdf_ad()`.
+  ///
+  /// @tparam reparam_s Flag indicating reparametrization of s.
+  /// @param[in] y Data.
+  /// @param[in] a GEV Location parameter.
+  /// @param[in] log_b GEV (log) scale parameter.
+  /// @param[in] s GEV Shape parameter (possibly transformed).
+  template <int reparam_s, class Type>
+  Type gev_reparam_lpdf(const Type y, const Type a, const Type log_b,
+			const Type s) {
+    if (isDouble<Type>::value) {
+      if (reparam_s == 0) return gumbel_lpdf<Type>(y, a, log_b);
+      return gev_lpdf<Type>(y, a, log_b, gev_reparam_shape<reparam_s, Type>(s));
+    }
+    if (reparam_s == 0) return gumbel_lpdf_ad<Type>(y, a, log_b);
+    return gev_lpdf_ad<Type>(y, a, log_b, gev_reparam_shape<reparam_s, Type>(s));
+  }
+
+  /// Vectorized log-likelihood of a block of GEV observations sharing the same
+  /// parameters.
+  ///
+  /// The sum over the block is computed with Eigen array expressions, which the
+  /// compiler can vectorize when `Type = double`.
+  ///
+  /// @tparam reparam_s Flag indicating reparametrization of s.
+  /// @param[in] y Vector of observations at a single location.
+  /// @param[in] a GEV Location parameter.
+  /// @param[in] log_b GEV (log) scale parameter.
+  /// @param[in] s GEV Shape parameter (possibly transformed).
+  ///
+  /// @return Sum of the log-densities of the elements of `y`.
+  template <int reparam_s, class Type>
+  Type gev_reparam_lpdf_batch(cRefVector_t<Type> y, const Type a,
+			      const Type log_b, const Type s) {
+    typedef Eigen::Array<Type, Eigen::Dynamic, 1> Array_t;
+    int n_obs = y.size();
+    if (n_obs == 0) return Type(0.0);
+    Array_t t = (y.array() - a) * exp(-log_b);
+    Type s_nat = Type(0.0);
+    if (reparam_s != 0) s_nat = gev_reparam_shape<reparam_s, Type>(s);
+    Type ll;
+    if (reparam_s == 0 || fabs(s_nat) <= 1e-7) {
+      // Gumbel distribution
+      ll = -((-t).exp() + t).sum();
+    } else {
+      Array_t log_t = (Type(1.0) + s_nat * t).log();
+      ll = -((-log_t / s_nat).exp() +
+	     (s_nat + Type(1.0)) / s_nat * log_t).sum();
+    }
+    return ll - Type(n_obs) * log_b;
+  }
+
+  /// Log-likelihood of a block of GEV observations sharing the same parameters.
+  ///
+  /// This is the grouped counterpart of `gev_reparam_lpdf()`.  For `Type =
+  /// double` it is computed by `gev_reparam_lpdf_batch()`.  For AD types, the
+  /// shape transformation is computed once for the whole block instead of once
+  /// per observation, and the block is then recorded as a single atomic node
+  /// via `gev_lpdf_block_ad()`.
+  ///
+  /// @tparam reparam_s Flag indicating reparametrization of s.
+  /// @param[in] y Vector of observations at a single location.
+  /// @param[in] a GEV Location parameter.
+  /// @param[in] log_b GEV (log) scale parameter.
+  /// @param[in] s GEV Shape parameter (possibly transformed).
+  ///
+  /// @return Sum of the log-densities of the elements of `y`.
+  template <int reparam_s, class Type>
+  Type gev_reparam_lpdf_block(cRefVector_t<Type> y, const Type a,
+			      const Type log_b, const Type s) {
+    if (isDouble<Type>::value) {
+      return gev_reparam_lpdf_batch<reparam_s, Type>(y, a, log_b, s);
+    }
+    if (reparam_s == 0) {
+      // Gumbel distribution
+      return gev_lpdf_block_ad<true, Type>(y, a, log_b, Type(0.0));
+    }
+    Type s_nat = gev_reparam_shape<reparam_s, Type>(s);
+    return gev_lpdf_block_ad<false, Type>(y, a, log_b, s_nat);
+  }
+
+  /// Log-likelihood of a block of GEV observations sharing the same parameters.
+  ///
+  /// Dispatches `reparam_s` to the compile-time version of
+  /// `gev_reparam_lpdf_block()`.
+  ///
+  /// @param[in] y Vector of observations at a single location.
+  /// @param[in] a GEV Location parameter.
+  /// @param[in] log_b GEV (log) scale parameter.
+  /// @param[in] s GEV Shape parameter (possibly transformed).
+  /// @param[in] reparam_s Flag indicating reparametrization of s.
+  template <class Type>
+  Type gev_reparam_lpdf_block(cRefVector_t<Type> y, const Type a,
+			      const Type log_b, const Type s,
+			      const int reparam_s) {
+    switch (reparam_s) {
+    case 0:
+      return gev_reparam_lpdf_block<0, Type>(y, a, log_b, s);
+    case 1:
+      return gev_reparam_lpdf_block<1, Type>(y, a, log_b, s);
+    case 2:
+      return gev_reparam_lpdf_block<2, Type>(y, a, log_b, s);
+    default:
+      return gev_reparam_lpdf_block<3, Type>(y, a, log_b, s);
+    }
+  }
+
+  /// Negative log-likelihood of a chunk of the GEV data layer.
+  ///
+  /// The data layout and the parametrization of s are fixed at compile time,
+  /// such that the loop over observations contains no branches.  The chunk
+  /// consists of the groups of observations (grouped layout) or observations
+  /// `begin <= i < end`, such that the data layer can be split over the
+  /// parallel regions of the model.
+  ///
+  /// @tparam reparam_s Flag indicating reparametrization of s.
+  /// @tparam random_b Whether `log_b` is a vector of length `n_loc` or a
+  /// scalar.
+  /// @tparam random_s Whether `s` is a vector of length `n_loc` or a scalar.
+  /// @param[in] y Response vector.
+  /// @param[in] loc_ind Location index of each element of `y`, or of each
+  /// group of observations in the grouped layout.
+  /// @param[in] obs_offset CSR-style offsets of the groups of observations in
+  /// the grouped layout, or a vector of length 1 otherwise.
+  /// @param[in] a GEV location parameter vector of length `n_loc`.
+  /// @param[in] log_b GEV (log) scale parameter vector.
+  /// @param[in] s GEV shape parameter vector (possibly transformed).
+  /// @param[in] begin Index of the first group or observation of the chunk.
+  /// @param[in] end One past the index of the last group or observation of
+  /// the chunk.
+  template <int reparam_s, bool random_b, bool random_s, class Type>
+  Type gev_data_nll(cRefVector_t<Type> y, cRefVector_t<int> loc_ind,
+		    cRefVector_t<int> obs_offset, cRefVector_t<Type> a,
+		    cRefVector_t<Type> log_b, cRefVector_t<Type> s,
+		    const int begin, const int end) {
+    Type nll = Type(0.0);
+    if (obs_offset.size() > 1) {
+      // grouped layout: one block of observations per location, evaluated
+      // with Eigen array expressions for double types and atomic nodes for AD
+      // types
+      for (int i = begin; i < end; i++) {
+	int j = loc_ind(i);
+	nll -= gev_reparam_lpdf_block<reparam_s, Type>(
+	  y.segment(obs_offset(i), obs_offset(i+1) - obs_offset(i)),
+	  a(j), log_b(random_b ? j : 0), s(random_s ? j : 0));
+      }
+    } else {
+      for (int i = begin; i < end; i++) {
+	int j = loc_ind(i);
+	nll -= gev_reparam_lpdf<reparam_s, Type>(
+	  y(i), a(j), log_b(random_b ? j : 0), s(random_s ? j : 0));
+      }
+    }
+    return nll;
+  }
+
+  /// Quantiles of the GEV distribution with compile-time reparametrization of
+  /// s.
+  ///
+  /// @tparam reparam_s Flag indicating reparametrization of s.
+  /// @param[out] quant Vector of quantiles to compute.
+  /// @param[in] prob Vector of probabilities at which to compute the quantiles.
+  /// @param[in] a GEV Location parameter vector.
+  /// @param[in] log_b GEV (log) scale parameter.
+  /// @param[in] s GEV Shape parameter (possibly transformed).
+  template <int reparam_s, class Type>
+  void gev_reparam_quantile(RefRowVector_t<Type> quant, cRefVector_t<Type>& prob,
+                            const Type a, const Type log_b, const Type s) {
+    Type _s = reparam_s == 0 ? Type(0.0) : gev_reparam_shape<reparam_s, Type>(s);
+    for (int i = 0; i < prob.size(); i++) {
+      quant(i) = gev_quantile<Type>(prob(i), a, log_b, _s, reparam_s == 0);
+    }
+    return;
+  }
 
   /// Quantiles of the GEV distribution based on different parameterizations of s.
   ///
+  /// Dispatches `reparam_s` to the compile-time version of
+  /// `gev_reparam_quantile()`.
+  ///
   /// @param[out] quant Vector of quantiles to compute.
   /// @param[in] prob Vector of probabilities at which to compute the quantiles.
   /// @param[in] a GEV Location parameter vector.
@@ -306,24 +1196,18 @@ namespace SpatialGEV {
   void gev_reparam_quantile(RefRowVector_t<Type> quant, cRefVector_t<Type>& prob,
                             const Type a, const Type log_b, const Type s,
                             const int reparam_s) {
-    // int n_quant = prob.size();
-    Type _b = exp(log_b);
-    // reparametrize s for s \neq 0
-    Type _s;
-    if(reparam_s == 1) {
-      _s = exp(s);
-    } else if(reparam_s == 2) {
-      _s = -exp(s);
-    } else if(reparam_s == 3) {
-      _s = s;
-    }
-    // calculate quantiles
-    if(reparam_s == 0) {
-      // Using Gumbel distribution
-      quant = a - _b * log(-log(prob.array()));
-    } else {
-      // Using full GEV distribution
-      quant = a + (_b/_s) * (pow(-log(prob.array()), -_s) - Type(1.0));
+    switch (reparam_s) {
+    case 0:
+      gev_reparam_quantile<0, Type>(quant, prob, a, log_b, s);
+      break;
+    case 1:
+      gev_reparam_quantile<1, Type>(quant, prob, a, log_b, s);
+      break;
+    case 2:
+      gev_reparam_quantile<2, Type>(quant, prob, a, log_b, s);
+      break;
+    default:
+      gev_reparam_quantile<3, Type>(quant, prob, a, log_b, s);
     }
     return;
   }
@@ -0,0 +1,10 @@
+// Generated by make_templates.R: do not edit by hand
+
+#define TMB_LIB_INIT R_init_SpatialGEV_model_a_nngp
+#include <TMB.hpp>
+#include "model_a_nngp.hpp"
+
+template<class Type>
+Type objective_function<Type>::operator() () {
+  return model_a_nngp(this);
+}
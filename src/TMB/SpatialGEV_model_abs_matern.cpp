@@ -0,0 +1,10 @@
+// Generated by make_templates.R: do not edit by hand
+
+#define TMB_LIB_INIT R_init_SpatialGEV_model_abs_matern
+#include <TMB.hpp>
+#include "model_abs_matern.hpp"
+
+template<class Type>
+Type objective_function<Type>::operator() () {
+  return model_abs_matern(this);
+}
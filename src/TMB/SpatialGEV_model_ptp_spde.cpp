@@ -0,0 +1,10 @@
+// Generated by make_templates.R: do not edit by hand
+
+#define TMB_LIB_INIT R_init_SpatialGEV_model_ptp_spde
+#include <TMB.hpp>
+#include "model_ptp_spde.hpp"
+
+template<class Type>
+Type objective_function<Type>::operator() () {
+  return model_ptp_spde(this);
+}
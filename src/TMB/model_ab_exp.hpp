@@ -19,7 +19,13 @@
 /// @param[in] y Response vector of length `n_obs`.  Assumed to be > 0.
 /// @param[in] loc_ind Location vector of length `n_obs` of integers
 /// `0 <= i_loc < n_loc` indicating to which locations each element of `y` is
-/// associated.
+/// associated.  For the grouped layout (see `obs_offset`), a vector of length
+/// `n_group` giving the location of each group of observations instead.
+/// @param[in] obs_offset CSR-style offsets for the grouped data layout: `y` is
+/// sorted by location and the observations of group `i` are
+/// `y[obs_offset(i):(obs_offset(i+1)-1)]`, so this is a vector of length
+/// `n_group + 1`.  If of length 1, each element of `y` is instead associated
+/// with its own entry of `loc_ind`.
 /// @param[in] reparam_s Integer indicating the type of shape parameter. 0:
 /// `s = 0`, i.e., use Gumbel instead of GEV distribution.  1: `s > 0`, in which
 /// case we operate on `log(s)`.  2: `s < 0`, in which case we operate on
@@ -32,8 +38,19 @@
 /// .
 /// @param[in] dist_mat `n_loc x n_loc` distance matrix typically constructed
 /// via `stats::dist(coordinates)`.
+/// In sparse mode (see `sp_thres`), a `0 x 0` matrix.
 /// @param[in] sp_thres Scalar number used to make the covariance matrix sparse
-/// by thresholding. If sp_thres=-1, no thresholding is made.
+/// by thresholding. If sp_thres=-1, no thresholding is made.  Otherwise the
+/// GP log-density is computed in sparse mode from `sp_nb` and `sp_dist`.
+/// @param[in] sp_taper Integer flag.  In sparse mode, 1 to multiply the
+/// correlations by a Wendland taper with support `sp_thres`, which keeps the
+/// correlation matrix positive definite, or 0 to set the correlations beyond
+/// `sp_thres` to zero.
+/// @param[in] sp_nb Integer matrix of size `n_pair x 2`, each row of which
+/// contains the (0-based) indices `i > j` of a pair of locations at distance
+/// less than `sp_thres`.
+/// @param[in] sp_dist Vector of length `n_pair` of distances between the pairs
+/// of locations in `sp_nb`.
 /// @param[in] design_mat_a Design matrix of size
 /// `n_loc x n_covariate` for parameter a.
 /// @param[in] beta_a_prior Vector of length 2 containing the mean
@@ -64,8 +81,12 @@
 /// hyperparameter for log_b.
 /// @param[in] log_ell_b GP covariance kernel range
 /// hyperparameter for log_b.
-template<class Type>
-Type model_ab_exp(objective_function<Type>* obj){
+///
+/// The parametrization of s is a template parameter, such that the data layer
+/// compiles without branches.  The model is called via
+/// `model_ab_exp()`, which dispatches `reparam_s` once.
+template<class Type, int reparam_s>
+Type model_ab_exp_t(objective_function<Type>* obj){
   using namespace density;
   using namespace R_inla;
   using namespace Eigen;
@@ -74,13 +95,15 @@ Type model_ab_exp(objective_function<Type>* obj){
   // ------ Data inputs ------------
   DATA_VECTOR(y);
   DATA_IVECTOR(loc_ind);
-  DATA_INTEGER(reparam_s);
+  DATA_IVECTOR(obs_offset);
   DATA_INTEGER(beta_prior);
   DATA_VECTOR(return_periods);
   int has_returns = return_periods(0) > Type(0.0);
   DATA_MATRIX(dist_mat);
   DATA_SCALAR(sp_thres);
-  int n_loc = dist_mat.rows(); // number of spatial dimensions
+  DATA_INTEGER(sp_taper);
+  DATA_IMATRIX(sp_nb);
+  DATA_VECTOR(sp_dist);
 
   // Inputs for a
   DATA_MATRIX(design_mat_a);
@@ -90,6 +113,7 @@ Type model_ab_exp(objective_function<Type>* obj){
   DATA_VECTOR(beta_b_prior);
   DATA_SCALAR(s_mean);
   DATA_SCALAR(s_sd);
+  int n_loc = design_mat_a.rows(); // number of spatial locations
 
   // ------------ Parameters ----------------------
 
@@ -104,52 +128,84 @@ Type model_ab_exp(objective_function<Type>* obj){
   PARAMETER(log_sigma_b);
   PARAMETER(log_ell_b);
 
-  // Initialize the negative log likelihood
+  // Initialize the negative log likelihood.  Each contribution to it is
+  // computed in a PARALLEL_REGION: with TMB::openmp(n_threads), the regions are
+  // distributed over the tapes of the threads, whose outputs are summed by TMB.
   Type nll = Type(0.0);
 
   // ---------- Likelihood contribution from a ------------------
+  PARALLEL_REGION {
   // GP latent layer
   vector<Type> mu_a = a -
     design_mat_a * beta_a;
-  nll += nlpdf_gp_exp<Type>(mu_a, dist_mat,
+  nll += nlpdf_gp_exp<Type>(mu_a, dist_mat, sp_nb, sp_dist,
 				   exp(log_sigma_a),
 				   exp(log_ell_a),
-                                   sp_thres);
+                                   sp_thres, sp_taper);
   // Priors
   nll += nlpdf_beta_prior<Type>(beta_a, beta_prior,
       beta_a_prior(0), beta_a_prior(1));
+  } // end PARALLEL_REGION
   // ---------- Likelihood contribution from log_b ------------------
+  PARALLEL_REGION {
   // GP latent layer
   vector<Type> mu_b = log_b -
     design_mat_b * beta_b;
-  nll += nlpdf_gp_exp<Type>(mu_b, dist_mat,
+  nll += nlpdf_gp_exp<Type>(mu_b, dist_mat, sp_nb, sp_dist,
 				   exp(log_sigma_b),
 				   exp(log_ell_b),
-                                   sp_thres);
+                                   sp_thres, sp_taper);
   // Priors
   nll += nlpdf_beta_prior<Type>(beta_b, beta_prior,
       beta_b_prior(0), beta_b_prior(1));
+  } // end PARALLEL_REGION
   // FIXME: rename this to not depend on `s`
-  nll += nlpdf_s_prior<Type>(s(0), s_mean, s_sd);
+  PARALLEL_REGION nll += nlpdf_s_prior<Type>(s(0), s_mean, s_sd);
 
   // ------------- Data layer -----------------
-  for(int i=0;i<y.size();i++) {
-    nll -= gev_reparam_lpdf<Type>(y(i), a(loc_ind(i)), log_b(loc_ind(i)),
-	s(0), reparam_s);
+  // one chunk of groups (or observations) per thread
+  int n_chunk = std::max(obj->max_parallel_regions, 1);
+  int n_unit = obs_offset.size() > 1 ? loc_ind.size() : y.size();
+  for(int k=0; k<n_chunk; k++) {
+    PARALLEL_REGION nll +=
+      gev_data_nll<reparam_s, true, false, Type>(
+        y, loc_ind, obs_offset, a, log_b, s,
+        k * n_unit / n_chunk, (k+1) * n_unit / n_chunk);
   }
 
   // ------------- Output return levels -----------------------
   if(has_returns) {
     matrix<Type> return_levels(return_periods.size(), n_loc);
     for(int i=0; i<n_loc; i++) {
-      gev_reparam_quantile<Type>(return_levels.col(i), return_periods,
-                                 a(i), log_b(i), s(0), reparam_s);
+      gev_reparam_quantile<reparam_s, Type>(return_levels.col(i),
+                                            return_periods, a(i),
+                                            log_b(i), s(0));
     }
     ADREPORT(return_levels);
   }
 
   return nll;
 }
+
+/// Dispatches the parametrization of s to the compile-time instantiation of
+/// `model_ab_exp_t()`.
+///
+/// @param[in] reparam_s Integer indicating the type of shape parameter, as
+/// described above.
+template<class Type>
+Type model_ab_exp(objective_function<Type>* obj){
+  DATA_INTEGER(reparam_s);
+  switch(reparam_s) {
+  case 0:
+    return model_ab_exp_t<Type, 0>(obj);
+  case 1:
+    return model_ab_exp_t<Type, 1>(obj);
+  case 2:
+    return model_ab_exp_t<Type, 2>(obj);
+  default:
+    return model_ab_exp_t<Type, 3>(obj);
+  }
+}
 #undef TMB_OBJECTIVE_PTR
 #define TMB_OBJECTIVE_PTR this
 
@@ -0,0 +1,285 @@
+#ifndef model_abs_nngp_hpp
+#define model_abs_nngp_hpp
+
+#include "SpatialGEV/utils.hpp"
+
+#undef TMB_OBJECTIVE_PTR
+#define TMB_OBJECTIVE_PTR obj
+
+/// TMB specification of GEV-GP models with a chosen covariance kernel.
+///
+/// The model is defined as follows:
+///
+/// y ~ GEV(a, b, s),
+/// a ~ GP(log_sigma_a, log_kappa_a)
+/// log_b ~ GP(log_sigma_b, log_kappa_b)
+/// s ~ GP(log_sigma_s, log_kappa_s)
+/// where the GP is parameterized using the nngp covariance kernel.
+///
+/// --------- Data provided from R ---------------
+/// @param[in] y Response vector of length `n_obs`.  Assumed to be > 0.
+/// @param[in] loc_ind Location vector of length `n_obs` of integers
+/// `0 <= i_loc < n_loc` indicating to which locations each element of `y` is
+/// associated.  For the grouped layout (see `obs_offset`), a vector of length
+/// `n_group` giving the location of each group of observations instead.
+/// @param[in] obs_offset CSR-style offsets for the grouped data layout: `y` is
+/// sorted by location and the observations of group `i` are
+/// `y[obs_offset(i):(obs_offset(i+1)-1)]`, so this is a vector of length
+/// `n_group + 1`.  If of length 1, each element of `y` is instead associated
+/// with its own entry of `loc_ind`.
+/// @param[in] reparam_s Integer indicating the type of shape parameter. 0:
+/// `s = 0`, i.e., use Gumbel instead of GEV distribution.  1: `s > 0`, in which
+/// case we operate on `log(s)`.  2: `s < 0`, in which case we operate on
+/// `log(-s)`.  3: unconstrained.
+/// @param[in] beta_prior Integer specifying the type of prior on the design
+/// matrix coefficients. 1 is weakly informative normal prior and any other
+/// numbers means Lebesgue prior `pi(beta) \propto 1`.
+/// @param[in] return_periods Vector of return periods to ADREPORT. If the first
+/// element of this vector is 0, then no return level calculations are performed
+/// .
+/// @param[in] nn_ind Integer matrix of size `n_loc x m` of (0-based) indices
+/// of the nearest neighbours of each location among the preceding ones, padded
+/// with -1.
+/// @param[in] nn_dist Array of size `(m+1) x (m+1) x n_loc` of distances
+/// between each location and its nearest neighbours.
+/// @param[in] design_mat_a Design matrix of size
+/// `n_loc x n_covariate` for parameter a.
+/// @param[in] beta_a_prior Vector of length 2 containing the mean
+/// and sd of the normal prior on `beta_a`.
+/// @param[in] design_mat_b Design matrix of size
+/// `n_loc x n_covariate` for parameter log_b.
+/// @param[in] beta_b_prior Vector of length 2 containing the mean
+/// and sd of the normal prior on `beta_b`.
+/// @param[in] design_mat_s Design matrix of size
+/// `n_loc x n_covariate` for parameter s.
+/// @param[in] beta_s_prior Vector of length 2 containing the mean
+/// and sd of the normal prior on `beta_s`.
+/// @param[in] nu Presepecified smoothness parameter for the Matérn covariance
+/// kernel applicable to all random effects.
+/// @param[in] a_pc_prior Integer specifying the type of prior to
+/// use on the Matérn GP on a. 1 for using PC prior on
+/// a, 0 for using Lebesgue prior.
+/// @param[in] range_a_prior PC prior on the range parameter for
+/// the Matérn GP on
+/// a. Vector of length 2 `(rho_0, p_rho)` s.t.
+/// `Pr(rho < rho_0) = p_rho`.
+/// @param[in] sigma_a_prior PC prior on the variance parameter for
+/// the Matérn GP on
+/// a. Vector of length 2 `(sig_0, p_sig)` s.t.
+/// `Pr(sig > sig_0) = p_sig`.
+/// @param[in] b_pc_prior Integer specifying the type of prior to
+/// use on the Matérn GP on log_b. 1 for using PC prior on
+/// log_b, 0 for using Lebesgue prior.
+/// @param[in] range_b_prior PC prior on the range parameter for
+/// the Matérn GP on
+/// log_b. Vector of length 2 `(rho_0, p_rho)` s.t.
+/// `Pr(rho < rho_0) = p_rho`.
+/// @param[in] sigma_b_prior PC prior on the variance parameter for
+/// the Matérn GP on
+/// log_b. Vector of length 2 `(sig_0, p_sig)` s.t.
+/// `Pr(sig > sig_0) = p_sig`.
+/// @param[in] s_pc_prior Integer specifying the type of prior to
+/// use on the Matérn GP on s. 1 for using PC prior on
+/// s, 0 for using Lebesgue prior.
+/// @param[in] range_s_prior PC prior on the range parameter for
+/// the Matérn GP on
+/// s. Vector of length 2 `(rho_0, p_rho)` s.t.
+/// `Pr(rho < rho_0) = p_rho`.
+/// @param[in] sigma_s_prior PC prior on the variance parameter for
+/// the Matérn GP on
+/// s. Vector of length 2 `(sig_0, p_sig)` s.t.
+/// `Pr(sig > sig_0) = p_sig`.
+///
+/// --------- Parameters to estimate ------------
+/// @param[in] a GEV location parameter.
+/// Vector of length `n_loc`.
+/// @param[in] log_b GEV scale parameter on the log scale.
+/// Vector of length `n_loc`.
+/// @param[in] s GEV shape parameter on the scale specified by `reparam_s`.
+/// Vector of length `n_loc`.
+/// @param[in] beta_a GP mean covariate coefficient vector of
+/// length `n_covariate` for a.
+/// @param[in] log_sigma_a GP covariance kernel variance
+/// hyperparameter for a.
+/// @param[in] log_kappa_a GP covariance kernel range
+/// hyperparameter for a.
+/// @param[in] beta_b GP mean covariate coefficient vector of
+/// length `n_covariate` for log_b.
+/// @param[in] log_sigma_b GP covariance kernel variance
+/// hyperparameter for log_b.
+/// @param[in] log_kappa_b GP covariance kernel range
+/// hyperparameter for log_b.
+/// @param[in] beta_s GP mean covariate coefficient vector of
+/// length `n_covariate` for s.
+/// @param[in] log_sigma_s GP covariance kernel variance
+/// hyperparameter for s.
+/// @param[in] log_kappa_s GP covariance kernel range
+/// hyperparameter for s.
+///
+/// The parametrization of s is a template parameter, such that the data layer
+/// compiles without branches.  The model is called via
+/// `model_abs_nngp()`, which dispatches `reparam_s` once.
+template<class Type, int reparam_s>
+Type model_abs_nngp_t(objective_function<Type>* obj){
+  using namespace density;
+  using namespace R_inla;
+  using namespace Eigen;
+  using namespace SpatialGEV;
+
+  // ------ Data inputs ------------
+  DATA_VECTOR(y);
+  DATA_IVECTOR(loc_ind);
+  DATA_IVECTOR(obs_offset);
+  DATA_INTEGER(beta_prior);
+  DATA_VECTOR(return_periods);
+  int has_returns = return_periods(0) > Type(0.0);
+  DATA_IMATRIX(nn_ind);
+  DATA_ARRAY(nn_dist);
+  DATA_SCALAR(nu);
+
+  // Inputs for a
+  DATA_MATRIX(design_mat_a);
+  DATA_VECTOR(beta_a_prior);
+  DATA_INTEGER(a_pc_prior);
+  DATA_VECTOR(range_a_prior);
+  DATA_VECTOR(sigma_a_prior);
+  // Inputs for log_b
+  DATA_MATRIX(design_mat_b);
+  DATA_VECTOR(beta_b_prior);
+  DATA_INTEGER(b_pc_prior);
+  DATA_VECTOR(range_b_prior);
+  DATA_VECTOR(sigma_b_prior);
+  // Inputs for s
+  DATA_MATRIX(design_mat_s);
+  DATA_VECTOR(beta_s_prior);
+  DATA_INTEGER(s_pc_prior);
+  DATA_VECTOR(range_s_prior);
+  DATA_VECTOR(sigma_s_prior);
+  int n_loc = design_mat_a.rows(); // number of spatial locations
+
+  // ------------ Parameters ----------------------
+
+  PARAMETER_VECTOR(a);
+  PARAMETER_VECTOR(log_b);
+  PARAMETER_VECTOR(s);
+
+  PARAMETER_VECTOR(beta_a);
+  PARAMETER_VECTOR(beta_b);
+  PARAMETER_VECTOR(beta_s);
+  PARAMETER(log_sigma_a);
+  PARAMETER(log_kappa_a);
+  PARAMETER(log_sigma_b);
+  PARAMETER(log_kappa_b);
+  PARAMETER(log_sigma_s);
+  PARAMETER(log_kappa_s);
+
+  // Initialize the negative log likelihood.  Each contribution to it is
+  // computed in a PARALLEL_REGION: with TMB::openmp(n_threads), the regions are
+  // distributed over the tapes of the threads, whose outputs are summed by TMB.
+  Type nll = Type(0.0);
+
+  // ---------- Likelihood contribution from a ------------------
+  PARALLEL_REGION {
+  // GP latent layer
+  vector<Type> mu_a = a -
+    design_mat_a * beta_a;
+  nll += nlpdf_gp_nngp<Type>(mu_a, nn_ind, nn_dist,
+				   exp(log_sigma_a),
+				   exp(log_kappa_a),
+                                   nu);
+  // Priors
+  nll += nlpdf_beta_prior<Type>(beta_a, beta_prior,
+      beta_a_prior(0), beta_a_prior(1));
+  nll += nlpdf_matern_hyperpar_prior<Type>(log_kappa_a,
+					   log_sigma_a,
+					   a_pc_prior,
+                                           nu, range_a_prior,
+					   sigma_a_prior);
+  } // end PARALLEL_REGION
+  // ---------- Likelihood contribution from log_b ------------------
+  PARALLEL_REGION {
+  // GP latent layer
+  vector<Type> mu_b = log_b -
+    design_mat_b * beta_b;
+  nll += nlpdf_gp_nngp<Type>(mu_b, nn_ind, nn_dist,
+				   exp(log_sigma_b),
+				   exp(log_kappa_b),
+                                   nu);
+  // Priors
+  nll += nlpdf_beta_prior<Type>(beta_b, beta_prior,
+      beta_b_prior(0), beta_b_prior(1));
+  nll += nlpdf_matern_hyperpar_prior<Type>(log_kappa_b,
+					   log_sigma_b,
+					   b_pc_prior,
+                                           nu, range_b_prior,
+					   sigma_b_prior);
+  } // end PARALLEL_REGION
+  // ---------- Likelihood contribution from s ------------------
+  PARALLEL_REGION {
+  // GP latent layer
+  vector<Type> mu_s = s -
+    design_mat_s * beta_s;
+  nll += nlpdf_gp_nngp<Type>(mu_s, nn_ind, nn_dist,
+				   exp(log_sigma_s),
+				   exp(log_kappa_s),
+                                   nu);
+  // Priors
+  nll += nlpdf_beta_prior<Type>(beta_s, beta_prior,
+      beta_s_prior(0), beta_s_prior(1));
+  nll += nlpdf_matern_hyperpar_prior<Type>(log_kappa_s,
+					   log_sigma_s,
+					   s_pc_prior,
+                                           nu, range_s_prior,
+					   sigma_s_prior);
+  } // end PARALLEL_REGION
+
+  // ------------- Data layer -----------------
+  // one chunk of groups (or observations) per thread
+  int n_chunk = std::max(obj->max_parallel_regions, 1);
+  int n_unit = obs_offset.size() > 1 ? loc_ind.size() : y.size();
+  for(int k=0; k<n_chunk; k++) {
+    PARALLEL_REGION nll +=
+      gev_data_nll<reparam_s, true, true, Type>(
+        y, loc_ind, obs_offset, a, log_b, s,
+        k * n_unit / n_chunk, (k+1) * n_unit / n_chunk);
+  }
+
+  // ------------- Output return levels -----------------------
+  if(has_returns) {
+    matrix<Type> return_levels(return_periods.size(), n_loc);
+    for(int i=0; i<n_loc; i++) {
+      gev_reparam_quantile<reparam_s, Type>(return_levels.col(i),
+                                            return_periods, a(i),
+                                            log_b(i), s(i));
+    }
+    ADREPORT(return_levels);
+  }
+
+  return nll;
+}
+
+/// Dispatches the parametrization of s to the compile-time instantiation of
+/// `model_abs_nngp_t()`.
+///
+/// @param[in] reparam_s Integer indicating the type of shape parameter, as
+/// described above.
+template<class Type>
+Type model_abs_nngp(objective_function<Type>* obj){
+  DATA_INTEGER(reparam_s);
+  switch(reparam_s) {
+  case 0:
+    return model_abs_nngp_t<Type, 0>(obj);
+  case 1:
+    return model_abs_nngp_t<Type, 1>(obj);
+  case 2:
+    return model_abs_nngp_t<Type, 2>(obj);
+  default:
+    return model_abs_nngp_t<Type, 3>(obj);
+  }
+}
+#undef TMB_OBJECTIVE_PTR
+#define TMB_OBJECTIVE_PTR this
+
+#endif
+
+
@@ -190,14 +190,14 @@ Type model_abs_spde_maxsmooth(objective_function<Type>* obj){
   DATA_VECTOR(return_periods);
   int n_loc = spde.M0.rows();
   int has_returns = return_periods(0) > Type(0.0);
-  matrix<Type> return_levels(return_periods.size(), n_loc);
   if (has_returns){
+    matrix<Type> return_levels(return_periods.size(), n_loc);
     for(int i=0; i<n_loc; i++) {
       gev_reparam_quantile<Type>(return_levels.col(i), return_periods,
                                  a(i), log_b(i), s(i), reparam_s);
     }
+    ADREPORT(return_levels);
   }
-  ADREPORT(return_levels);
 
   return nll;
 
@@ -24,10 +24,7 @@ Type model_gev(objective_function<Type>* obj) {
 
   Type nll = Type(0.0);
 
-  for(int i=0; i<y.size(); i++) {
-    nll -= gev_reparam_lpdf<Type>(y(i), a, log_b, s,
-				  reparam_s);
-  }
+  nll -= gev_reparam_lpdf_block<Type>(y, a, log_b, s, reparam_s);
   nll += nlpdf_s_prior<Type>(s, s_prior(0), s_prior(1));
 
 
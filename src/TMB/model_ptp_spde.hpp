@@ -23,6 +23,9 @@ Type model_ptp_spde(objective_function<Type>* obj){
   // data inputs
   DATA_VECTOR(y); // response vector: mws. Assumed to be > 0
   DATA_IVECTOR(loc_ind); // location index to which each observation in y is associated
+  // CSR-style offsets of the grouped data layout, in which case loc_ind is the
+  // location index of each group.  If of length 1, the per-observation layout is used.
+  DATA_IVECTOR(obs_offset);
   DATA_MATRIX(design_mat_psi); // n x r design matrix
   DATA_MATRIX(design_mat_tau);
   DATA_MATRIX(design_mat_phi);
@@ -78,10 +81,18 @@ Type model_ptp_spde(objective_function<Type>* obj){
   // calculate the negative log likelihood
   Type nll = Type(0.0);
   // data layer
-  int reparam_s = 3; // unconstrained s
-  for(int i=0;i<y.size();i++) {
-    nll -= gev_reparam_lpdf<Type>(y[i], a[loc_ind[i]], log_b[loc_ind[i]],
-                                  s[loc_ind[i]], reparam_s);
+  // s is unconstrained
+  if(obs_offset.size() > 1) {
+    for(int i=0;i<loc_ind.size();i++) {
+      nll -= gev_reparam_lpdf_block<3, Type>(
+        y.segment(obs_offset[i], obs_offset[i+1] - obs_offset[i]),
+        a[loc_ind[i]], log_b[loc_ind[i]], s[loc_ind[i]]);
+    }
+  } else {
+    for(int i=0;i<y.size();i++) {
+      nll -= gev_reparam_lpdf<3, Type>(y[i], a[loc_ind[i]], log_b[loc_ind[i]],
+                                       s[loc_ind[i]]);
+    }
   }
   // GP latent layer
   vector<Type> mu_psi = psi - design_mat_psi * beta_psi;
@@ -0,0 +1,78 @@
+/// @file call_utils.hpp
+///
+/// @brief Conversion of `.Call` arguments between R and Eigen.
+
+#ifndef SPATIALGEV_CALL_UTILS_HPP
+#define SPATIALGEV_CALL_UTILS_HPP
+
+#include <cstdio>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <Eigen/Dense>
+#ifndef R_NO_REMAP
+#define R_NO_REMAP
+#endif
+#include <Rinternals.h>
+
+namespace SpatialGEV {
+
+  /// Read-only view of a numeric R matrix.
+  ///
+  /// @param[in] x R object of storage mode `double` with a `dim` attribute.
+  /// @param[in] name Name of the argument, for the error message.
+  inline Eigen::Map<const Eigen::MatrixXd> as_matrix(SEXP x, const char* name) {
+    if (!Rf_isReal(x) || !Rf_isMatrix(x)) {
+      throw std::invalid_argument(std::string("'") + name +
+				  "' must be a numeric matrix.");
+    }
+    return Eigen::Map<const Eigen::MatrixXd>(REAL(x), Rf_nrows(x), Rf_ncols(x));
+  }
+
+  /// Read-only view of a numeric R vector.
+  ///
+  /// @param[in] x R object of storage mode `double`.
+  /// @param[in] name Name of the argument, for the error message.
+  inline Eigen::Map<const Eigen::VectorXd> as_vector(SEXP x, const char* name) {
+    if (!Rf_isReal(x)) {
+      throw std::invalid_argument(std::string("'") + name +
+				  "' must be a numeric vector.");
+    }
+    return Eigen::Map<const Eigen::VectorXd>(REAL(x), XLENGTH(x));
+  }
+
+  /// Copy an Eigen matrix into a newly allocated R matrix.
+  ///
+  /// @param[in] x Matrix to copy.
+  ///
+  /// @return An unprotected R matrix.
+  inline SEXP to_sexp(const Eigen::MatrixXd& x) {
+    SEXP out = Rf_allocMatrix(REALSXP, x.rows(), x.cols());
+    Eigen::Map<Eigen::MatrixXd>(REAL(out), x.rows(), x.cols()) = x;
+    return out;
+  }
+
+  /// Run the body of a `.Call` entry point, turning C++ exceptions into R
+  /// errors.
+  ///
+  /// `Rf_error()` does not return, so it is called after the exception and
+  /// all C++ objects of `body` have been destroyed.
+  ///
+  /// @param[in] body Function object with signature `SEXP()`.
+  template <class F>
+  SEXP call_guard(F body) {
+    char msg[1024] = "";
+    try {
+      return body();
+    } catch (const std::exception& e) {
+      std::snprintf(msg, sizeof(msg), "%s", e.what());
+    } catch (...) {
+      std::snprintf(msg, sizeof(msg), "Unknown C++ exception.");
+    }
+    Rf_error("%s", msg);
+    return R_NilValue;
+  }
+
+} // end namespace SpatialGEV
+
+#endif
@@ -1,10 +1,28 @@
-// Dummy file required so that useDynLib(SpatialGEV, .registration=TRUE) doesn't fail on empty 'src'
-
+// Registration of the .Call routines of the main package library.  The TMB
+// models are compiled into their own libraries in src/TMB.
 #include <Rinternals.h>
 #include <R_ext/Rdynload.h>
 #include <R_ext/Visibility.h>
 
-void attribute_visible R_init_SpatialGEV(DllInfo *dll) {
-  R_registerRoutines(dll, NULL, NULL, NULL, NULL);
+extern "C" {
+  SEXP SpatialGEV_krige(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP,
+			SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+  SEXP SpatialGEV_rgev(SEXP, SEXP, SEXP, SEXP);
+  SEXP SpatialGEV_rmvn(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+  SEXP SpatialGEV_return_levels(SEXP, SEXP, SEXP, SEXP, SEXP);
+  SEXP SpatialGEV_nearest_neighbors(SEXP, SEXP);
+}
+
+static const R_CallMethodDef CallEntries[] = {
+  {"SpatialGEV_krige", (DL_FUNC) &SpatialGEV_krige, 14},
+  {"SpatialGEV_rgev", (DL_FUNC) &SpatialGEV_rgev, 4},
+  {"SpatialGEV_rmvn", (DL_FUNC) &SpatialGEV_rmvn, 8},
+  {"SpatialGEV_return_levels", (DL_FUNC) &SpatialGEV_return_levels, 5},
+  {"SpatialGEV_nearest_neighbors", (DL_FUNC) &SpatialGEV_nearest_neighbors, 2},
+  {NULL, NULL, 0}
+};
+
+extern "C" void attribute_visible R_init_SpatialGEV(DllInfo *dll) {
+  R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
   R_useDynamicSymbols(dll, FALSE);
 }
@@ -0,0 +1,56 @@
+/// @file krige.cpp
+///
+/// @brief `.Call` entry point for the conditional simulation of a Gaussian
+/// process at new locations.
+
+#include <SpatialGEV/sim.hpp>
+#include "call_utils.hpp"
+
+/// Conditional simulation of a Gaussian process at new locations.
+///
+/// Wrapper to `SpatialGEV::gp_cond_sim()` if `joint` is true and to
+/// `SpatialGEV::gp_cond_sim_marginal()` otherwise, for which the arguments are
+/// documented.
+///
+/// @return Matrix of size `n_new x n_draw` of GP values at the new locations.
+extern "C" SEXP SpatialGEV_krige(SEXP locs_obs, SEXP locs_new,
+				 SEXP kernel, SEXP nu,
+				 SEXP field_obs, SEXP mean_obs, SEXP mean_new,
+				 SEXP sigma, SEXP range,
+				 SEXP max_rank, SEXP rank_tol,
+				 SEXP joint, SEXP tile_size, SEXP n_threads) {
+  using namespace SpatialGEV;
+  return call_guard([&]() {
+    Eigen::MatrixXd field_new;
+    GetRNGstate();
+    try {
+      if (Rf_asLogical(joint)) {
+	field_new = gp_cond_sim(as_matrix(locs_obs, "locs_obs"),
+				as_matrix(locs_new, "locs_new"),
+				Rf_asInteger(kernel), Rf_asReal(nu),
+				as_matrix(field_obs, "field_obs"),
+				as_matrix(mean_obs, "mean_obs"),
+				as_matrix(mean_new, "mean_new"),
+				as_vector(sigma, "sigma"),
+				as_vector(range, "range"),
+				Rf_asInteger(max_rank), Rf_asReal(rank_tol));
+      } else {
+	field_new = gp_cond_sim_marginal(as_matrix(locs_obs, "locs_obs"),
+					 as_matrix(locs_new, "locs_new"),
+					 Rf_asInteger(kernel), Rf_asReal(nu),
+					 as_matrix(field_obs, "field_obs"),
+					 as_matrix(mean_obs, "mean_obs"),
+					 as_matrix(mean_new, "mean_new"),
+					 as_vector(sigma, "sigma"),
+					 as_vector(range, "range"),
+					 Rf_asInteger(tile_size),
+					 Rf_asInteger(n_threads));
+      }
+    } catch (...) {
+      PutRNGstate();
+      throw;
+    }
+    PutRNGstate();
+    return to_sexp(field_new);
+  });
+}
@@ -0,0 +1,149 @@
+/// @file nearest_neighbors.cpp
+///
+/// @brief `.Call` entry point for the nearest neighbor search of the NNGP
+/// kernel.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <Eigen/Dense>
+#include "call_utils.hpp"
+
+namespace SpatialGEV {
+
+  /// Nearest neighbors of each location among the preceding ones.
+  ///
+  /// The preceding locations are bucketed in a regular grid over the first two
+  /// coordinates, with cells sized to hold about `n_neighbors` locations each.
+  /// The neighbors of each location are searched in rings of cells of
+  /// increasing radius around its own cell, until the ring lies farther away
+  /// than the `n_neighbors`-th nearest location found so far.  Ties in
+  /// distance are broken by the index of the location.
+  ///
+  /// @param[in] locs Matrix of size `n_loc x d` of coordinates.
+  /// @param[in] n_neighbors Maximum number of neighbors per location.
+  ///
+  /// @return Matrix of size `n_loc x n_neighbors` of 0-based indices of the
+  /// neighbors of each location, sorted by distance and padded with -1.
+  inline Eigen::MatrixXi nearest_neighbors(const Eigen::Ref<const Eigen::MatrixXd>& locs,
+					   const int n_neighbors) {
+    int n_loc = locs.rows();
+    Eigen::MatrixXi nn_ind = Eigen::MatrixXi::Constant(n_loc, n_neighbors, -1);
+    if (n_loc == 0 || n_neighbors <= 0) return nn_ind;
+    // grid over the first two coordinates
+    Eigen::MatrixXd grid_locs = Eigen::MatrixXd::Zero(n_loc, 2);
+    int n_grid_dim = std::min(2, static_cast<int>(locs.cols()));
+    grid_locs.leftCols(n_grid_dim) = locs.leftCols(n_grid_dim);
+    Eigen::RowVector2d grid_min = grid_locs.colwise().minCoeff();
+    Eigen::RowVector2d grid_range = grid_locs.colwise().maxCoeff() - grid_min;
+    double cell_size = std::max(std::sqrt(grid_range.prod() * n_neighbors / n_loc),
+				grid_range.maxCoeff() * n_neighbors / n_loc);
+    if (cell_size == 0.0) cell_size = 1.0;
+    int n_cell[2];
+    for (int k = 0; k < 2; k++) {
+      n_cell[k] = static_cast<int>(std::floor(grid_range(k) / cell_size)) + 1;
+    }
+    int max_ring = std::max(n_cell[0], n_cell[1]);
+    std::vector<int> cell_x(n_loc), cell_y(n_loc);
+    for (int i = 0; i < n_loc; i++) {
+      cell_x[i] = std::min(static_cast<int>(std::floor((grid_locs(i,0) - grid_min(0)) / cell_size)),
+			   n_cell[0] - 1);
+      cell_y[i] = std::min(static_cast<int>(std::floor((grid_locs(i,1) - grid_min(1)) / cell_size)),
+			   n_cell[1] - 1);
+    }
+    std::vector<std::vector<int> > buckets(static_cast<size_t>(n_cell[0]) * n_cell[1]);
+    std::vector<int> cand, order;
+    std::vector<double> cand_dist, kth;
+    for (int i = 0; i < n_loc; i++) {
+      int n_nb = std::min(n_neighbors, i);
+      if (n_nb > 0) {
+	cand.clear();
+	cand_dist.clear();
+	for (int r = 0; ; r++) {
+	  // cells at Chebyshev distance r from the cell of location i
+	  for (int dy = -r; dy <= r; dy++) {
+	    int y = cell_y[i] + dy;
+	    if (y < 0 || y >= n_cell[1]) continue;
+	    int step = (dy == -r || dy == r) ? 1 : 2 * r;
+	    for (int dx = -r; dx <= r; dx += step) {
+	      int x = cell_x[i] + dx;
+	      if (x < 0 || x >= n_cell[0]) continue;
+	      for (int j : buckets[x + static_cast<size_t>(n_cell[0]) * y]) {
+		cand.push_back(j);
+		cand_dist.push_back((locs.row(i) - locs.row(j)).norm());
+	      }
+	    }
+	  }
+	  // locations outside of rings 0, ..., r are at least r * cell_size away
+	  if (static_cast<int>(cand.size()) >= n_nb) {
+	    kth = cand_dist;
+	    std::nth_element(kth.begin(), kth.begin() + n_nb - 1, kth.end());
+	    if (kth[n_nb - 1] < r * cell_size) break;
+	  }
+	  if (r >= max_ring) break;
+	}
+	order.resize(cand.size());
+	for (size_t k = 0; k < cand.size(); k++) order[k] = k;
+	std::partial_sort(order.begin(), order.begin() + n_nb, order.end(),
+			  [&](int k, int l) {
+			    return cand_dist[k] < cand_dist[l] ||
+			      (cand_dist[k] == cand_dist[l] && cand[k] < cand[l]);
+			  });
+	for (int k = 0; k < n_nb; k++) nn_ind(i,k) = cand[order[k]];
+      }
+      buckets[cell_x[i] + static_cast<size_t>(n_cell[0]) * cell_y[i]].push_back(i);
+    }
+    return nn_ind;
+  }
+
+} // end namespace SpatialGEV
+
+/// Nearest neighbors of each location among the preceding ones.
+///
+/// @param[in] locs Numeric matrix of size `n_loc x d` of coordinates.
+/// @param[in] n_neighbors Maximum number of neighbors per location.
+///
+/// @return List with elements `nn_ind`, the output of
+/// `SpatialGEV::nearest_neighbors()`, and `nn_dist`, an array of size
+/// `(n_neighbors+1) x (n_neighbors+1) x n_loc` such that `nn_dist[,,i]` is the
+/// distance matrix between location `i` (first row) and its neighbors, padded
+/// with zeros.
+extern "C" SEXP SpatialGEV_nearest_neighbors(SEXP locs, SEXP n_neighbors) {
+  using namespace SpatialGEV;
+  return call_guard([&]() {
+    Eigen::Map<const Eigen::MatrixXd> locs_ = as_matrix(locs, "locs");
+    int n_loc = locs_.rows();
+    int n_nb = Rf_asInteger(n_neighbors);
+    if (n_nb == NA_INTEGER || n_nb < 0) {
+      throw std::invalid_argument("'n_neighbors' must be a nonnegative integer.");
+    }
+    Eigen::MatrixXi nn_ind = nearest_neighbors(locs_, n_nb);
+    SEXP out = PROTECT(Rf_allocVector(VECSXP, 2));
+    SEXP nn_ind_ = Rf_allocMatrix(INTSXP, n_loc, n_nb);
+    SET_VECTOR_ELT(out, 0, nn_ind_);
+    Eigen::Map<Eigen::MatrixXi>(INTEGER(nn_ind_), n_loc, n_nb) = nn_ind;
+    SEXP nn_dist = Rf_alloc3DArray(REALSXP, n_nb + 1, n_nb + 1, n_loc);
+    SET_VECTOR_ELT(out, 1, nn_dist);
+    int m = n_nb + 1;
+    double* dist = REAL(nn_dist);
+    std::fill(dist, dist + static_cast<size_t>(m) * m * n_loc, 0.0);
+    std::vector<int> id;
+    for (int i = 0; i < n_loc; i++) {
+      id.assign(1, i);
+      for (int k = 0; k < n_nb && nn_ind(i,k) >= 0; k++) id.push_back(nn_ind(i,k));
+      double* dist_i = dist + static_cast<size_t>(m) * m * i;
+      for (size_t l = 0; l < id.size(); l++) {
+	for (size_t k = 0; k < l; k++) {
+	  dist_i[k + m * l] = dist_i[l + m * k] =
+	    (locs_.row(id[k]) - locs_.row(id[l])).norm();
+	}
+      }
+    }
+    SEXP names = PROTECT(Rf_allocVector(STRSXP, 2));
+    SET_STRING_ELT(names, 0, Rf_mkChar("nn_ind"));
+    SET_STRING_ELT(names, 1, Rf_mkChar("nn_dist"));
+    Rf_setAttrib(out, R_NamesSymbol, names);
+    UNPROTECT(2);
+    return out;
+  });
+}
@@ -0,0 +1,54 @@
+/// @file return_levels.cpp
+///
+/// @brief `.Call` entry point for the return levels and their gradients.
+
+#include <SpatialGEV/sim.hpp>
+#include "call_utils.hpp"
+
+/// Return levels and their gradients with respect to the GEV parameters.
+///
+/// Calls `SpatialGEV::gev_reparam_quantile_jac()` at each location.
+///
+/// @param[in] prob Vector of return-level probabilities.
+/// @param[in] a Vector of GEV location parameters, one per location.
+/// @param[in] log_b Vector of GEV (log) scale parameters, one per location.
+/// @param[in] s Vector of GEV shape parameters (possibly transformed), one per
+/// location.
+/// @param[in] reparam_s Flag indicating reparametrization of s.
+///
+/// @return List with elements `return_levels`, a matrix of size `n_prob x
+/// n_loc`, and `jac`, a matrix of size `n_prob n_loc x 3` of the derivatives
+/// of `return_levels`, in column-major order, with respect to `a`, `log_b` and
+/// `s` at the same location.
+extern "C" SEXP SpatialGEV_return_levels(SEXP prob, SEXP a, SEXP log_b, SEXP s,
+					 SEXP reparam_s) {
+  using namespace SpatialGEV;
+  return call_guard([&]() {
+    Eigen::Map<const Eigen::VectorXd> prob_ = as_vector(prob, "prob");
+    Eigen::Map<const Eigen::VectorXd> a_ = as_vector(a, "a");
+    Eigen::Map<const Eigen::VectorXd> log_b_ = as_vector(log_b, "log_b");
+    Eigen::Map<const Eigen::VectorXd> s_ = as_vector(s, "s");
+    if (log_b_.size() != a_.size() || s_.size() != a_.size()) {
+      throw std::invalid_argument("'a', 'log_b' and 's' must have the same length.");
+    }
+    int n_prob = prob_.size();
+    int n_loc = a_.size();
+    int reparam_s_ = Rf_asInteger(reparam_s);
+    Eigen::MatrixXd return_levels(n_prob, n_loc);
+    Eigen::MatrixXd jac(n_prob * n_loc, 3);
+    for (int i = 0; i < n_loc; i++) {
+      gev_reparam_quantile_jac(return_levels.col(i),
+			       jac.middleRows(i * n_prob, n_prob),
+			       prob_, a_(i), log_b_(i), s_(i), reparam_s_);
+    }
+    SEXP out = PROTECT(Rf_allocVector(VECSXP, 2));
+    SET_VECTOR_ELT(out, 0, to_sexp(return_levels));
+    SET_VECTOR_ELT(out, 1, to_sexp(jac));
+    SEXP names = PROTECT(Rf_allocVector(STRSXP, 2));
+    SET_STRING_ELT(names, 0, Rf_mkChar("return_levels"));
+    SET_STRING_ELT(names, 1, Rf_mkChar("jac"));
+    Rf_setAttrib(out, R_NamesSymbol, names);
+    UNPROTECT(2);
+    return out;
+  });
+}
@@ -0,0 +1,31 @@
+/// @file rgev.cpp
+///
+/// @brief `.Call` entry point for random draws from the GEV distribution.
+
+#include <SpatialGEV/sim.hpp>
+#include "call_utils.hpp"
+
+/// Random draws from the GEV distribution.
+///
+/// Wrapper to `SpatialGEV::gev_reparam_rand()`, for which the arguments are
+/// documented.  The parameter vectors must all have the same length.
+///
+/// @return Vector of GEV draws of the same length as `a`.
+extern "C" SEXP SpatialGEV_rgev(SEXP a, SEXP log_b, SEXP s, SEXP reparam_s) {
+  using namespace SpatialGEV;
+  return call_guard([&]() {
+    Eigen::Map<const Eigen::VectorXd> a_ = as_vector(a, "a");
+    Eigen::Map<const Eigen::VectorXd> log_b_ = as_vector(log_b, "log_b");
+    Eigen::Map<const Eigen::VectorXd> s_ = as_vector(s, "s");
+    if (log_b_.size() != a_.size() || s_.size() != a_.size()) {
+      throw std::invalid_argument("'a', 'log_b' and 's' must have the same length.");
+    }
+    SEXP y = PROTECT(Rf_allocVector(REALSXP, a_.size()));
+    GetRNGstate();
+    gev_reparam_rand(Eigen::Map<Eigen::VectorXd>(REAL(y), a_.size()),
+		     a_, log_b_, s_, Rf_asInteger(reparam_s));
+    PutRNGstate();
+    UNPROTECT(1);
+    return y;
+  });
+}
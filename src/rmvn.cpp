@@ -0,0 +1,47 @@
+/// @file rmvn.cpp
+///
+/// @brief `.Call` entry point for random draws from a multivariate normal with
+/// sparse precision matrix.
+
+#include <SpatialGEV/sim.hpp>
+#include "call_utils.hpp"
+
+/// Random draws from a multivariate normal with sparse precision matrix.
+///
+/// Wrapper to `SpatialGEV::rmvn_chol_sim()`, for which the arguments are
+/// documented.  The Cholesky factor is passed as the slots of a `dgCMatrix`.
+///
+/// @param[in] L_i Integer vector of 0-based row indices of the factor.
+/// @param[in] L_p Integer vector of 0-based column pointers of the factor.
+/// @param[in] L_x Numeric vector of nonzero entries of the factor.
+///
+/// @return Matrix of size `length(mean) x n_draw`, each column of which is a
+/// draw.
+extern "C" SEXP SpatialGEV_rmvn(SEXP L_i, SEXP L_p, SEXP L_x, SEXP perm,
+				SEXP mean, SEXP n_draw, SEXP block_size,
+				SEXP n_threads) {
+  using namespace SpatialGEV;
+  return call_guard([&]() {
+    Eigen::Map<const Eigen::VectorXd> mean_ = as_vector(mean, "mean");
+    int d = mean_.size();
+    if (!Rf_isInteger(L_i) || !Rf_isInteger(L_p) || !Rf_isInteger(perm) ||
+	XLENGTH(L_p) != d + 1 || XLENGTH(perm) != d) {
+      throw std::invalid_argument("Invalid Cholesky factor.");
+    }
+    Eigen::Map<const Eigen::VectorXd> L_x_ = as_vector(L_x, "L_x");
+    if (XLENGTH(L_i) != L_x_.size() || INTEGER(L_p)[d] != L_x_.size()) {
+      throw std::invalid_argument("Invalid Cholesky factor.");
+    }
+    Eigen::Map<const Eigen::SparseMatrix<double> > L(d, d, L_x_.size(),
+						       INTEGER(L_p),
+						       INTEGER(L_i),
+						       L_x_.data());
+    Eigen::Map<const Eigen::VectorXi> perm_(INTEGER(perm), d);
+    GetRNGstate();
+    Eigen::MatrixXd x = rmvn_chol_sim(L, perm_, mean_, Rf_asInteger(n_draw),
+				      Rf_asInteger(block_size),
+				      Rf_asInteger(n_threads));
+    PutRNGstate();
+    return to_sexp(x);
+  });
+}